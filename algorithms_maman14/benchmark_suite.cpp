@@ -0,0 +1,571 @@
+/*
+ * benchmark_suite.cpp
+ *
+ *  The sorting and priority queue benchmark suite.
+ */
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <queue>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "benchmark_suite.h"
+#include "heap.h"
+#include "unlimited.h"
+
+using namespace std::chrono;
+
+using namespace AlgorithmsMaman14;
+
+namespace {
+
+// Every timed sample sorts at least this many elements, small inputs are sorted in batches
+const std::size_t MIN_SAMPLE_ELEMENTS = 1 << 16;
+// Number of distinct keys of the few_unique distribution
+const std::uint64_t FEW_UNIQUE_KEYS = 16;
+// All keys are below this, so every element type holds them exactly and orders them alike
+const std::uint64_t KEY_LIMIT = 1ULL << 31;
+// Digits of the string keys, zero padded so that strings order like the numbers they hold
+const int STRING_KEY_DIGITS = 10;
+
+const char* const ALL_DISTRIBUTIONS[] = {"random", "sorted", "reversed", "organ_pipe", "few_unique", "zipf"};
+const char* const ALL_TYPES[] = {"int", "uint64", "double", "string", "struct64", "struct256", "unlimited"};
+const char* const ALL_ALGORITHMS[] = {"heap_sort", "dheap_queue", "std_sort", "std_heap", "std_priority_queue"};
+
+// A record of Bytes bytes, ordered by its first 8 bytes
+template <std::size_t Bytes>
+struct PaddedKey
+{
+	std::uint64_t key;
+	char payload[Bytes - sizeof(std::uint64_t)];
+
+	bool operator<(const PaddedKey& other) const
+	{
+		return key < other.key;
+	}
+
+	bool operator>(const PaddedKey& other) const
+	{
+		return key > other.key;
+	}
+};
+
+/* Builds an element of the type from a key below KEY_LIMIT.
+ * heapBytes estimates the memory an element owns outside of itself, for the memory budget.
+ */
+template <typename T>
+struct Element
+{
+	static T make(std::uint64_t key)
+	{
+		return static_cast<T>(key);
+	}
+
+	static std::size_t heapBytes()
+	{
+		return 0;
+	}
+};
+
+template <>
+struct Element<std::string>
+{
+	static std::string make(std::uint64_t key)
+	{
+		std::ostringstream digits;
+		digits << std::setw(STRING_KEY_DIGITS) << std::setfill('0') << key;
+		return digits.str();
+	}
+
+	// The keys fit the small string buffer of the common standard libraries
+	static std::size_t heapBytes()
+	{
+		return 0;
+	}
+};
+
+template <std::size_t Bytes>
+struct Element<PaddedKey<Bytes>>
+{
+	static PaddedKey<Bytes> make(std::uint64_t key)
+	{
+		PaddedKey<Bytes> element;
+		element.key = key;
+		std::fill(std::begin(element.payload), std::end(element.payload), static_cast<char>(key));
+		return element;
+	}
+
+	static std::size_t heapBytes()
+	{
+		return 0;
+	}
+};
+
+template <>
+struct Element<Unlimited>
+{
+	static Unlimited make(std::uint64_t key)
+	{
+		return Unlimited(std::to_string(key));
+	}
+
+	// A digit per int and the allocation's bookkeeping
+	static std::size_t heapBytes()
+	{
+		return STRING_KEY_DIGITS * sizeof(int) + 16;
+	}
+};
+
+/* Draws the keys of a distribution of size elements:
+ * random     - uniform over [0, KEY_LIMIT)
+ * sorted     - 0, 1 .. size - 1
+ * reversed   - size - 1 .. 1, 0
+ * organ_pipe - ascending up to the middle and descending from there
+ * few_unique - uniform over FEW_UNIQUE_KEYS keys
+ * zipf       - key k (of size keys) with a probability of about 1 / (k + 1), the continuous
+ *              approximation of Zipf's law with s = 1 (rank k + 1 is drawn as (size + 1)^u)
+ */
+class KeyDistribution
+{
+public:
+	KeyDistribution(const std::string& name_, std::size_t size_, std::uint64_t seed)
+	: name(name_)
+	, size(size_)
+	, generator(seed)
+	{
+	}
+
+	std::uint64_t keyAt(std::size_t i)
+	{
+		if (name == "sorted")
+			return i;
+		if (name == "reversed")
+			return size - 1 - i;
+		if (name == "organ_pipe")
+			return i < size / 2 ? i : size - 1 - i;
+		if (name == "few_unique")
+			return generator() % FEW_UNIQUE_KEYS * (KEY_LIMIT / FEW_UNIQUE_KEYS);
+		if (name == "zipf")
+		{
+			auto rank = std::pow(static_cast<double>(size) + 1, uniform(generator));
+			return std::min<std::uint64_t>(static_cast<std::uint64_t>(rank), size) - 1;
+		}
+
+		return generator() % KEY_LIMIT;
+	}
+
+private:
+	std::string name;
+	std::size_t size;
+	std::mt19937_64 generator;
+	std::uniform_real_distribution<double> uniform;
+};
+
+template <typename T>
+std::vector<T> makeInput(const std::string& distribution, std::size_t size, std::uint64_t seed)
+{
+	KeyDistribution keys(distribution, size, seed);
+	std::vector<T> input;
+	input.reserve(size);
+	for (std::size_t i = 0; i < size; ++i)
+		input.push_back(Element<T>::make(keys.keyAt(i)));
+
+	return input;
+}
+
+// Pushes all the elements into a DHeap and pops them back in ascending order
+template <std::size_t Sons, typename T>
+void drainDHeap(std::size_t numberOfSons, std::vector<T>& elements)
+{
+	DHeap<T, std::vector<T>, Sons> heap(numberOfSons);
+	for (auto& element : elements)
+		heap.push(std::move(element));
+	for (auto i = elements.size(); i > 0; --i)
+		elements[i - 1] = heap.pop();
+}
+
+// Like heap_sort, a number of sons with a compile-time heap is dispatched to it
+template <typename T>
+void drainDHeap(std::size_t numberOfSons, std::vector<T>& elements)
+{
+	switch (numberOfSons)
+	{
+	case 2: return drainDHeap<2>(numberOfSons, elements);
+	case 3: return drainDHeap<3>(numberOfSons, elements);
+	case 4: return drainDHeap<4>(numberOfSons, elements);
+	case 5: return drainDHeap<5>(numberOfSons, elements);
+	case 8: return drainDHeap<8>(numberOfSons, elements);
+	case 16: return drainDHeap<16>(numberOfSons, elements);
+	}
+
+	drainDHeap<RUNTIME_ARITY>(numberOfSons, elements);
+}
+
+// The standard library's queue, its top can only be copied out
+template <typename T>
+void drainPriorityQueue(std::vector<T>& elements)
+{
+	std::priority_queue<T> queue;
+	for (auto& element : elements)
+		queue.push(std::move(element));
+	for (auto i = elements.size(); i > 0; --i)
+	{
+		elements[i - 1] = queue.top();
+		queue.pop();
+	}
+}
+
+// Sorts the elements in ascending order with the algorithm, d is ignored by the baselines
+template <typename T>
+void runAlgorithm(const std::string& algorithm, std::size_t d, std::vector<T>& elements)
+{
+	if (algorithm == "heap_sort")
+		heap_sort(d, elements);
+	else if (algorithm == "dheap_queue")
+		drainDHeap(d, elements);
+	else if (algorithm == "std_sort")
+		std::sort(elements.begin(), elements.end());
+	else if (algorithm == "std_heap")
+	{
+		std::make_heap(elements.begin(), elements.end());
+		std::sort_heap(elements.begin(), elements.end());
+	}
+	else
+		drainPriorityQueue(elements);
+}
+
+bool isBaseline(const std::string& algorithm)
+{
+	return algorithm != "heap_sort" && algorithm != "dheap_queue";
+}
+
+struct Measurement
+{
+	std::string type;
+	std::string distribution;
+	std::size_t size;
+	std::string algorithm;
+	// 0 for the baselines
+	std::size_t d;
+	std::size_t runs;
+	double medianNanoseconds;
+	double p95Nanoseconds;
+
+	double nanosecondsPerElement() const
+	{
+		return medianNanoseconds / size;
+	}
+};
+
+/* Times runs of the algorithm on copies of a batch of inputs, after warm-up runs.
+ * Returns the nanoseconds of every measured run (per input), sorted. Throws if the algorithm did not sort.
+ */
+template <typename T>
+std::vector<double> timeRuns(const std::string& algorithm, std::size_t d, const std::vector<std::vector<T>>& inputs, std::size_t warmupRuns, std::size_t measuredRuns)
+{
+	auto batch = inputs.size();
+
+	std::vector<double> samples;
+	for (std::size_t run = 0; run < warmupRuns + measuredRuns; ++run)
+	{
+		auto copies = inputs;
+
+		auto start = steady_clock::now();
+		for (auto& copy : copies)
+			runAlgorithm(algorithm, d, copy);
+		auto elapsed = duration_cast<nanoseconds>(steady_clock::now() - start);
+
+		for (const auto& copy : copies)
+			if (!std::is_sorted(copy.begin(), copy.end()))
+				throw std::logic_error(algorithm + " did not sort its input");
+
+		if (run >= warmupRuns)
+			samples.push_back(static_cast<double>(elapsed.count()) / batch);
+	}
+
+	std::sort(samples.begin(), samples.end());
+	return samples;
+}
+
+// The nearest-rank percentile of sorted samples
+double percentile(const std::vector<double>& sorted, double fraction)
+{
+	auto rank = static_cast<std::size_t>(std::ceil(fraction * sorted.size()));
+	return sorted[std::max<std::size_t>(rank, 1) - 1];
+}
+
+double median(const std::vector<double>& sorted)
+{
+	auto middle = sorted.size() / 2;
+	return sorted.size() % 2 ? sorted[middle] : (sorted[middle - 1] + sorted[middle]) / 2;
+}
+
+// Writes the measurements in the chosen format, as they are made
+class Report
+{
+public:
+	Report(const std::string& format_, std::ostream& out_)
+	: format(format_)
+	, out(out_)
+	, measurements(0)
+	{
+		out << std::fixed << std::setprecision(2);
+		if (format == "csv")
+			out << "type,distribution,size,algorithm,d,runs,median_ns,p95_ns,ns_per_element" << std::endl;
+		else if (format == "json")
+			out << "[";
+	}
+
+	~Report()
+	{
+		if (format == "json")
+			out << (measurements ? "\n" : "") << "]" << std::endl;
+	}
+
+	void add(const Measurement& measurement)
+	{
+		if (format == "csv")
+			out << measurement.type << "," << measurement.distribution << "," << measurement.size << ","
+				<< measurement.algorithm << "," << measurement.d << "," << measurement.runs << ","
+				<< measurement.medianNanoseconds << "," << measurement.p95Nanoseconds << ","
+				<< measurement.nanosecondsPerElement() << std::endl;
+		else if (format == "json")
+			out << (measurements ? "," : "") << "\n  {\"type\": \"" << measurement.type
+				<< "\", \"distribution\": \"" << measurement.distribution
+				<< "\", \"size\": " << measurement.size
+				<< ", \"algorithm\": \"" << measurement.algorithm
+				<< "\", \"d\": " << measurement.d
+				<< ", \"runs\": " << measurement.runs
+				<< ", \"median_ns\": " << measurement.medianNanoseconds
+				<< ", \"p95_ns\": " << measurement.p95Nanoseconds
+				<< ", \"ns_per_element\": " << measurement.nanosecondsPerElement() << "}" << std::flush;
+		else
+		{
+			out << measurement.type << " " << measurement.distribution << " " << measurement.size << " " << measurement.algorithm;
+			if (measurement.d)
+				out << " d = " << measurement.d;
+			out << ": median " << measurement.medianNanoseconds / 1000 << "us, p95 " << measurement.p95Nanoseconds / 1000
+				<< "us, " << measurement.nanosecondsPerElement() << "ns/element" << std::endl;
+		}
+
+		++measurements;
+	}
+
+private:
+	std::string format;
+	std::ostream& out;
+	std::size_t measurements;
+};
+
+// Measures every distribution, size, algorithm and d of the options on elements of type T
+template <typename T>
+void measureType(const std::string& type, const BenchmarkSuiteOptions& options, Report& report)
+{
+	for (const auto& distribution : options.distributions)
+		for (auto size : options.sizes)
+		{
+			/* Small inputs are timed in batches, every input of a batch is drawn with its own seed,
+			 * so that the branch predictors cannot learn a single input that is sorted over and over.
+			 * The memory holds the batch, its copies and a queue's worth of elements.
+			 */
+			auto batch = std::max<std::size_t>(1, MIN_SAMPLE_ELEMENTS / size);
+			auto bytes = (2 * batch + 1) * size * (sizeof(T) + Element<T>::heapBytes());
+			if (bytes > options.memoryBudget)
+			{
+				std::cerr << "skipping " << type << " " << distribution << " " << size << ", it needs about "
+						  << (bytes >> 20) << "MB" << std::endl;
+				continue;
+			}
+
+			std::vector<std::vector<T>> inputs;
+			for (std::size_t seed = 0; seed < batch; ++seed)
+				inputs.push_back(makeInput<T>(distribution, size, seed));
+
+			for (const auto& algorithm : options.algorithms)
+			{
+				std::vector<std::size_t> arities(1, 0);
+				if (!isBaseline(algorithm))
+					arities = options.arities;
+
+				for (auto d : arities)
+				{
+					auto samples = timeRuns(algorithm, d, inputs, options.warmupRuns, options.measuredRuns);
+					report.add(Measurement{type, distribution, size, algorithm, d, samples.size(), median(samples), percentile(samples, 0.95)});
+				}
+			}
+		}
+}
+
+template <std::size_t N>
+std::vector<std::string> allOf(const char* const (&names)[N])
+{
+	return std::vector<std::string>(names, names + N);
+}
+
+std::vector<std::string> splitList(const std::string& list)
+{
+	std::vector<std::string> items;
+	std::istringstream stream(list);
+	std::string item;
+	while (std::getline(stream, item, ','))
+		items.push_back(item);
+
+	return items;
+}
+
+// Parses "low..high" or a comma separated list of numbers
+std::vector<std::size_t> parseNumbers(const std::string& option, const std::string& value)
+{
+	std::vector<std::size_t> numbers;
+	try
+	{
+		auto dots = value.find("..");
+		if (dots != std::string::npos)
+		{
+			auto low = std::stoull(value.substr(0, dots)), high = std::stoull(value.substr(dots + 2));
+			for (auto number = low; number <= high; ++number)
+				numbers.push_back(number);
+		}
+		else
+			for (const auto& item : splitList(value))
+				numbers.push_back(std::stoull(item));
+	}
+	catch (const std::logic_error&)
+	{
+		throw InvalidSuiteOptionException(option);
+	}
+
+	if (numbers.empty())
+		throw InvalidSuiteOptionException(option);
+
+	return numbers;
+}
+
+// Parses a comma separated list of names, every one of them has to be one of known
+template <std::size_t N>
+std::vector<std::string> parseNames(const std::string& option, const std::string& value, const char* const (&known)[N])
+{
+	auto names = splitList(value);
+	for (const auto& name : names)
+		if (std::find(known, known + N, name) == known + N)
+			throw InvalidSuiteOptionException(option);
+
+	if (names.empty())
+		throw InvalidSuiteOptionException(option);
+
+	return names;
+}
+
+}
+
+BenchmarkSuiteOptions::BenchmarkSuiteOptions()
+: distributions(allOf(ALL_DISTRIBUTIONS))
+, types(allOf(ALL_TYPES))
+, algorithms(allOf(ALL_ALGORITHMS))
+, warmupRuns(1)
+, measuredRuns(5)
+, format("text")
+, memoryBudget(static_cast<std::size_t>(sysconf(_SC_PHYS_PAGES)) * sysconf(_SC_PAGESIZE) / 2)
+{
+	for (std::size_t size = 100; size <= 1000000; size *= 10)
+		sizes.push_back(size);
+	for (std::size_t d = 2; d <= 16; ++d)
+		arities.push_back(d);
+}
+
+BenchmarkSuiteOptions parseBenchmarkSuiteOptions(int argc, char* argv[], int first)
+{
+	BenchmarkSuiteOptions options;
+	for (int i = first; i < argc; ++i)
+	{
+		std::string argument = argv[i];
+		auto equals = argument.find('=');
+		if (argument.compare(0, 2, "--") != 0 || equals == std::string::npos)
+			throw InvalidSuiteOptionException(argument);
+
+		auto option = argument.substr(0, equals), value = argument.substr(equals + 1);
+		if (option == "--sizes")
+		{
+			options.sizes.clear();
+			for (auto exponent : parseNumbers(argument, value))
+			{
+				if (exponent > 18)
+					throw InvalidSuiteOptionException(argument);
+				options.sizes.push_back(static_cast<std::size_t>(std::pow(10.0, static_cast<double>(exponent)) + 0.5));
+			}
+		}
+		else if (option == "--distributions")
+			options.distributions = parseNames(argument, value, ALL_DISTRIBUTIONS);
+		else if (option == "--types")
+			options.types = parseNames(argument, value, ALL_TYPES);
+		else if (option == "--algorithms")
+			options.algorithms = parseNames(argument, value, ALL_ALGORITHMS);
+		else if (option == "--d")
+		{
+			options.arities = parseNumbers(argument, value);
+			for (auto d : options.arities)
+				if (d < 2)
+					throw InvalidSuiteOptionException(argument);
+		}
+		else if (option == "--warmup")
+			options.warmupRuns = parseNumbers(argument, value).front();
+		else if (option == "--runs")
+		{
+			options.measuredRuns = parseNumbers(argument, value).front();
+			if (options.measuredRuns == 0)
+				throw InvalidSuiteOptionException(argument);
+		}
+		else if (option == "--format")
+		{
+			if (value != "text" && value != "csv" && value != "json")
+				throw InvalidSuiteOptionException(argument);
+			options.format = value;
+		}
+		else if (option == "--output")
+			options.output = value;
+		else if (option == "--memory")
+			options.memoryBudget = parseNumbers(argument, value).front() << 20;
+		else
+			throw InvalidSuiteOptionException(argument);
+	}
+
+	return options;
+}
+
+void runBenchmarkSuite(const BenchmarkSuiteOptions& options)
+{
+	std::ofstream file;
+	if (!options.output.empty())
+	{
+		file.open(options.output);
+		if (!file)
+			throw InvalidSuiteOptionException("--output=" + options.output);
+	}
+
+	Report report(options.format, options.output.empty() ? std::cout : file);
+	for (const auto& type : options.types)
+	{
+		if (type == "int")
+			measureType<int>(type, options, report);
+		else if (type == "uint64")
+			measureType<std::uint64_t>(type, options, report);
+		else if (type == "double")
+			measureType<double>(type, options, report);
+		else if (type == "string")
+			measureType<std::string>(type, options, report);
+		else if (type == "struct64")
+			measureType<PaddedKey<64>>(type, options, report);
+		else if (type == "struct256")
+			measureType<PaddedKey<256>>(type, options, report);
+		else
+			measureType<Unlimited>(type, options, report);
+	}
+}
@@ -0,0 +1,70 @@
+/*
+ * benchmark_suite.h
+ *
+ *  The sorting and priority queue benchmark suite.
+ *
+ *  Times heap_sort and a push-all/pop-all DHeap workload for every d against std::sort,
+ *  std::make_heap + std::sort_heap and std::priority_queue, over a matrix of element types,
+ *  input distributions and sizes. Every measurement is preceded by warm-up runs, the measured runs
+ *  are reported by their median and 95th percentile and as ns per element, as text, CSV or JSON.
+ */
+
+#ifndef BENCHMARK_SUITE_H_
+#define BENCHMARK_SUITE_H_
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+struct InvalidSuiteOptionException : public std::invalid_argument
+{
+	explicit InvalidSuiteOptionException(const std::string& option)
+	: std::invalid_argument("invalid benchmark suite option " + option)
+	{
+	}
+};
+
+/* What the suite measures and how it reports it, the defaults run every type, distribution,
+ * algorithm and d from 2 to 16 on 10^2 .. 10^6 elements.
+ */
+struct BenchmarkSuiteOptions
+{
+	BenchmarkSuiteOptions();
+
+	// Element counts
+	std::vector<std::size_t> sizes;
+	// random, sorted, reversed, organ_pipe, few_unique, zipf
+	std::vector<std::string> distributions;
+	// int, uint64, double, string, struct64, struct256, unlimited
+	std::vector<std::string> types;
+	// heap_sort, dheap_queue, std_sort, std_heap, std_priority_queue
+	std::vector<std::string> algorithms;
+	// The numbers of sons the DHeap algorithms run with
+	std::vector<std::size_t> arities;
+	std::size_t warmupRuns;
+	std::size_t measuredRuns;
+	// text, csv or json
+	std::string format;
+	// The report's file, the standard output when empty
+	std::string output;
+	// Measurements whose input and copies would take more bytes than this are skipped
+	std::size_t memoryBudget;
+};
+
+/* Parses the options of "dheap suite", starting at argv[first]:
+ *   --sizes=2..9            powers of 10 (a range or a list, e.g. --sizes=3,6,9)
+ *   --distributions=random,zipf
+ *   --types=int,string
+ *   --algorithms=heap_sort,std_sort
+ *   --d=2..16               numbers of sons (a range or a list)
+ *   --warmup=1 --runs=5
+ *   --format=text|csv|json
+ *   --output=file
+ *   --memory=MB
+ * Throws InvalidSuiteOptionException for an unknown option or value.
+ */
+BenchmarkSuiteOptions parseBenchmarkSuiteOptions(int argc, char* argv[], int first);
+
+void runBenchmarkSuite(const BenchmarkSuiteOptions& options);
+
+#endif /* BENCHMARK_SUITE_H_ */
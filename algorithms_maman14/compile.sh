@@ -1,2 +1,2 @@
 #!/bin/bash
-g++ -std=c++0x *.cpp -o dheap
+g++ -std=c++0x -pthread *.cpp -o dheap
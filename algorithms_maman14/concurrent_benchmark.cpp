@@ -0,0 +1,261 @@
+/*
+ * concurrent_benchmark.cpp
+ *
+ *  Multi-threaded benchmarks of the concurrent heaps.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "concurrent_heap.h"
+#include "concurrent_benchmark.h"
+
+using namespace std::chrono;
+using std::cout;
+using std::endl;
+
+using namespace AlgorithmsMaman14;
+
+namespace {
+
+// Keys are drawn from [0, KEY_RANGE), small enough to rank them with a Fenwick tree
+const std::uint32_t KEY_RANGE = 1 << 20;
+// Elements in the queue before the measured operations start
+const std::size_t PREFILLED_ELEMENTS = 1 << 20;
+
+// The plain alternative, a single DHeap behind a mutex
+class LockedDHeap
+{
+public:
+	LockedDHeap(std::size_t numberOfSons, std::size_t)
+	: heap(numberOfSons)
+	{
+	}
+
+	void push(std::uint32_t element)
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		heap.push(element);
+	}
+
+	bool try_pop(std::uint32_t& out)
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		return heap.try_pop(out);
+	}
+
+private:
+	std::mutex lock;
+	DHeap<std::uint32_t> heap;
+};
+
+// Counts the keys currently in the queue, rank(key) is the number of keys larger than key
+class KeyRanks
+{
+public:
+	KeyRanks()
+	: counts(KEY_RANGE + 1)
+	, total(0)
+	{
+	}
+
+	void add(std::uint32_t key, int count)
+	{
+		total += count;
+		for (std::size_t i = key + 1; i <= KEY_RANGE; i += i & (0 - i))
+			counts[i] += count;
+	}
+
+	std::size_t rank(std::uint32_t key) const
+	{
+		std::size_t notLarger = 0;
+		for (std::size_t i = key + 1; i > 0; i -= i & (0 - i))
+			notLarger += counts[i];
+
+		return total - notLarger;
+	}
+
+private:
+	std::vector<std::size_t> counts;
+	std::size_t total;
+};
+
+/* Every thread alternates between pushing a random key and popping, operations in total.
+ * Returns the operations per second.
+ */
+template <typename Queue>
+double measureThroughput(std::size_t threads, std::size_t operations)
+{
+	Queue queue(4, threads);
+	std::mt19937 generator(threads);
+	for (std::size_t i = 0; i < PREFILLED_ELEMENTS; ++i)
+		queue.push(generator() % KEY_RANGE);
+
+	auto work = [&](std::size_t thread)
+	{
+		std::mt19937 keys(thread);
+		std::uint32_t popped;
+		for (std::size_t i = 0; i < operations / threads; i += 2)
+		{
+			queue.push(keys() % KEY_RANGE);
+			queue.try_pop(popped);
+		}
+	};
+
+	auto start = steady_clock::now();
+	std::vector<std::thread> workers;
+	for (std::size_t thread = 1; thread < threads; ++thread)
+		workers.emplace_back(work, thread);
+	work(0);
+	for (auto& worker : workers)
+		worker.join();
+
+	return operations / duration<double>(steady_clock::now() - start).count();
+}
+
+struct RankError
+{
+	double mean;
+	std::size_t p99;
+	std::size_t max;
+};
+
+/* The rank error depends on the number of shards rather than on the interleaving of the threads,
+ * so it is measured on the calling thread, where the exact rank of every pop is known.
+ */
+RankError measureRankError(std::size_t threads, std::size_t operations)
+{
+	ConcurrentDHeap<std::uint32_t> queue(4, threads);
+	KeyRanks ranks;
+	std::mt19937 generator(threads);
+	for (std::size_t i = 0; i < PREFILLED_ELEMENTS; ++i)
+	{
+		auto key = generator() % KEY_RANGE;
+		queue.push(key);
+		ranks.add(key, 1);
+	}
+
+	std::vector<std::size_t> errors;
+	for (std::size_t i = 0; i < operations; i += 2)
+	{
+		auto key = generator() % KEY_RANGE;
+		queue.push(key);
+		ranks.add(key, 1);
+
+		std::uint32_t popped;
+		queue.try_pop(popped);
+		errors.push_back(ranks.rank(popped));
+		ranks.add(popped, -1);
+	}
+
+	std::sort(errors.begin(), errors.end());
+	double sum = 0;
+	for (auto error : errors)
+		sum += error;
+
+	return RankError{errors.empty() ? 0 : sum / errors.size(),
+					 errors.empty() ? 0 : errors[errors.size() * 99 / 100],
+					 errors.empty() ? 0 : errors.back()};
+}
+
+// Pops every key off a FlatCombiningDHeap on the calling thread, a strict queue pops them from the largest down
+void assertStrictOrder(std::size_t elements)
+{
+	FlatCombiningDHeap<std::uint32_t> queue(4, 1);
+	std::mt19937 generator(elements);
+	for (std::size_t i = 0; i < elements; ++i)
+		queue.push(generator() % KEY_RANGE);
+
+	std::size_t popped = 0;
+	for (std::uint32_t previous = KEY_RANGE, key; queue.try_pop(key); previous = key, ++popped)
+	{
+		if (key > previous)
+		{
+			cout << "FlatCombiningDHeap popped " << key << " after " << previous << endl;
+			exit(-1);
+		}
+	}
+
+	if (popped != elements)
+	{
+		cout << "FlatCombiningDHeap popped " << popped << " of " << elements << " keys" << endl;
+		exit(-1);
+	}
+}
+
+/* Every thread alternates between pushing a random key and popping, then the queue is drained.
+ * The keys popped by all the threads must be exactly the keys pushed by them.
+ */
+void assertSameKeys(std::size_t threads, std::size_t operations)
+{
+	FlatCombiningDHeap<std::uint32_t> queue(4, threads);
+	std::vector<std::vector<std::uint32_t>> pushed(threads), popped(threads);
+
+	auto work = [&](std::size_t thread)
+	{
+		std::mt19937 keys(thread);
+		std::uint32_t key;
+		for (std::size_t i = 0; i < operations / threads; i += 2)
+		{
+			pushed[thread].push_back(keys() % KEY_RANGE);
+			queue.push(pushed[thread].back());
+			if (queue.try_pop(key))
+				popped[thread].push_back(key);
+		}
+	};
+
+	std::vector<std::thread> workers;
+	for (std::size_t thread = 1; thread < threads; ++thread)
+		workers.emplace_back(work, thread);
+	work(0);
+	for (auto& worker : workers)
+		worker.join();
+
+	std::uint32_t key;
+	while (queue.try_pop(key))
+		popped[0].push_back(key);
+
+	std::vector<std::uint32_t> allPushed, allPopped;
+	for (std::size_t thread = 0; thread < threads; ++thread)
+	{
+		allPushed.insert(allPushed.end(), pushed[thread].begin(), pushed[thread].end());
+		allPopped.insert(allPopped.end(), popped[thread].begin(), popped[thread].end());
+	}
+
+	std::sort(allPushed.begin(), allPushed.end());
+	std::sort(allPopped.begin(), allPopped.end());
+	if (allPushed != allPopped)
+	{
+		cout << "FlatCombiningDHeap with " << threads << " threads popped " << allPopped.size()
+			 << " keys, not the " << allPushed.size() << " keys pushed" << endl;
+		exit(-1);
+	}
+}
+
+}
+
+void benchmarkMultiQueue(std::size_t maxThreads, std::size_t operations)
+{
+	assertStrictOrder(PREFILLED_ELEMENTS);
+
+	for (std::size_t threads = 1; threads <= maxThreads; threads *= 2)
+	{
+		assertSameKeys(threads, operations);
+
+		auto multiQueue = measureThroughput<ConcurrentDHeap<std::uint32_t>>(threads, operations);
+		auto combining = measureThroughput<FlatCombiningDHeap<std::uint32_t>>(threads, operations);
+		auto locked = measureThroughput<LockedDHeap>(threads, operations);
+		auto error = measureRankError(threads, operations);
+
+		cout << threads << " threads: ConcurrentDHeap " << static_cast<std::size_t>(multiQueue) << " ops/s, "
+			 << "FlatCombiningDHeap " << static_cast<std::size_t>(combining) << " ops/s, "
+			 << "locked DHeap " << static_cast<std::size_t>(locked) << " ops/s, "
+			 << "rank error mean " << error.mean << ", p99 " << error.p99 << ", max " << error.max << endl;
+	}
+}
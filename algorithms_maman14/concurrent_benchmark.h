@@ -0,0 +1,18 @@
+/*
+ * concurrent_benchmark.h
+ *
+ *  Multi-threaded benchmarks of the concurrent heaps.
+ */
+
+#ifndef CONCURRENT_BENCHMARK_H_
+#define CONCURRENT_BENCHMARK_H_
+#include <cstddef>
+
+/* Runs a mixed push/pop workload on ConcurrentDHeap, FlatCombiningDHeap and a mutex guarded DHeap
+ * with 1, 2, 4 .. maxThreads threads, reporting the ops/s and the rank error of ConcurrentDHeap's pops
+ * (the other two are strict). Exits if FlatCombiningDHeap pops its keys out of order on a single thread,
+ * or pops other keys than the threads pushed.
+ */
+void benchmarkMultiQueue(std::size_t maxThreads, std::size_t operations);
+
+#endif /* CONCURRENT_BENCHMARK_H_ */
@@ -0,0 +1,398 @@
+/*
+ * concurrent_heap.h
+ *
+ *  Thread-safe priority queues built from DHeaps.
+ *
+ *  ConcurrentDHeap - a relaxed MultiQueue: shardsPerThread x threads DHeaps, each behind a spinlock.
+ *                    A push goes to a random shard, a pop takes the better root of two random shards,
+ *                    so pops scale with the threads at the price of a small rank error.
+ *  FlatCombiningDHeap - a strict queue: threads publish their requests in slots and whichever thread
+ *                       takes the lock executes all the published requests against a single DHeap.
+ */
+
+#ifndef CONCURRENT_HEAP_H_
+#define CONCURRENT_HEAP_H_
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "heap.h"
+
+namespace AlgorithmsMaman14{
+
+// Default number of shards ConcurrentDHeap keeps per thread
+const std::size_t MULTIQUEUE_SHARDS_PER_THREAD = 2;
+
+// A test-and-test-and-set lock for short critical sections
+class SpinLock
+{
+public:
+	SpinLock()
+	: locked(false)
+	{
+	}
+
+	bool try_lock()
+	{
+		return !locked.load(std::memory_order_relaxed) && !locked.exchange(true, std::memory_order_acquire);
+	}
+
+	void lock()
+	{
+		while (!try_lock())
+			std::this_thread::yield();
+	}
+
+	void unlock()
+	{
+		locked.store(false, std::memory_order_release);
+	}
+
+private:
+	std::atomic<bool> locked;
+};
+
+// xorshift64*, a generator per thread is cheap enough to pick a shard on every operation
+inline std::size_t randomShardNumber()
+{
+	static thread_local std::uint64_t state = std::hash<std::thread::id>()(std::this_thread::get_id()) | 1;
+	state ^= state >> 12;
+	state ^= state << 25;
+	state ^= state >> 27;
+	return static_cast<std::size_t>((state * 2685821657736338717ULL) >> 32);
+}
+
+/* A relaxed concurrent priority queue over DHeap shards.
+ * try_pop() returns an element close to the root, not necessarily the root itself: the expected rank of
+ * the popped element among all the elements is in the order of the number of shards.
+ * try_pop() fails only when all the shards were seen empty.
+ */
+template <typename T, typename Compare = Less, typename Projection = Identity>
+class ConcurrentDHeap
+{
+public:
+	typedef DHeap<T, std::vector<T>, RUNTIME_ARITY, Compare, Projection> Heap;
+
+	ConcurrentDHeap(std::size_t numberOfSons, std::size_t threads = std::thread::hardware_concurrency(),
+					std::size_t shardsPerThread = MULTIQUEUE_SHARDS_PER_THREAD,
+					const Compare& compare = Compare(), const Projection& projection = Projection())
+	: shards(std::max<std::size_t>(std::max<std::size_t>(threads, 1) * shardsPerThread, 2))
+	{
+		for (auto& shard : shards)
+			shard.heap.reset(new Heap(numberOfSons, orderBy(compare, projection)));
+	}
+
+	void push(const T& element)
+	{
+		Shard& shard = lockRandomShard();
+		shard.heap->push(element);
+		shard.lock.unlock();
+	}
+
+	void push(T&& element)
+	{
+		Shard& shard = lockRandomShard();
+		shard.heap->push(std::move(element));
+		shard.lock.unlock();
+	}
+
+	/* Pops the better root of two random shards into out.
+	 * When both are empty the other shards are tried in order, returns false if all of them are empty.
+	 */
+	bool try_pop(T& out)
+	{
+		for (;;)
+		{
+			auto first = randomShardNumber() % shards.size();
+			auto second = randomShardNumber() % shards.size();
+			if (first == second)
+				continue;
+			if (!shards[first].lock.try_lock())
+				continue;
+			if (!shards[second].lock.try_lock())
+			{
+				shards[first].lock.unlock();
+				continue;
+			}
+
+			Heap& firstHeap = *shards[first].heap;
+			Heap& secondHeap = *shards[second].heap;
+			bool popped = false;
+			if (!firstHeap.isEmpty() || !secondHeap.isEmpty())
+			{
+				bool takeSecond = firstHeap.isEmpty() || (!secondHeap.isEmpty() && secondHeap.outranks(secondHeap.root(), firstHeap.root()));
+				popped = (takeSecond ? secondHeap : firstHeap).try_pop(out);
+			}
+
+			shards[second].lock.unlock();
+			shards[first].lock.unlock();
+			if (popped)
+				return true;
+
+			return popAnyShard(out);
+		}
+	}
+
+	std::size_t numberOfShards() const
+	{
+		return shards.size();
+	}
+
+private:
+	struct alignas(CACHE_LINE_SIZE) Shard
+	{
+		SpinLock lock;
+		std::unique_ptr<Heap> heap;
+	};
+
+	Shard& lockRandomShard()
+	{
+		for (;;)
+		{
+			Shard& shard = shards[randomShardNumber() % shards.size()];
+			if (shard.lock.try_lock())
+				return shard;
+		}
+	}
+
+	// Pops the root of the first shard that is not empty
+	bool popAnyShard(T& out)
+	{
+		for (auto& shard : shards)
+		{
+			shard.lock.lock();
+			bool popped = shard.heap->try_pop(out);
+			shard.lock.unlock();
+
+			if (popped)
+				return true;
+		}
+
+		return false;
+	}
+
+	// Every shard takes its own cache line, so the locks of neighbouring shards do not share one
+	std::vector<Shard, AlignedAllocator<Shard>> shards;
+};
+
+/* A strict concurrent priority queue, DHeap semantics are kept: a pop returns the root.
+ * A thread publishes its push or pop in a free slot and spins until it is served. Whichever thread
+ * takes the lock becomes the combiner and serves all the published requests in one pass: the pushes
+ * go in as a single push_range and the pops then take the roots one after the other, from the best down,
+ * so the heap stays in the combiner's cache and the other threads do not queue on the lock.
+ * There are maxThreads slots, T has to be default constructible.
+ * An exception thrown while serving a pass (e.g. bad_alloc or a throwing move or compare of T) is rethrown
+ * to every request of the pass that was not served yet. The heap stays valid, but the elements of failed
+ * pushes may or may not be in it.
+ */
+template <typename T, typename Compare = Less, typename Projection = Identity>
+class FlatCombiningDHeap
+{
+public:
+	typedef DHeap<T, std::vector<T>, RUNTIME_ARITY, Compare, Projection> Heap;
+
+	FlatCombiningDHeap(std::size_t numberOfSons, std::size_t maxThreads = std::thread::hardware_concurrency(),
+					   const Compare& compare = Compare(), const Projection& projection = Projection())
+	: slots(std::max<std::size_t>(maxThreads, 1))
+	, heap(numberOfSons, orderBy(compare, projection))
+	{
+		// The combiner then only allocates inside the heap
+		pushes.reserve(slots.size());
+		pops.reserve(slots.size());
+		batch.reserve(slots.size());
+	}
+
+	void push(const T& element)
+	{
+		publishPush(element);
+	}
+
+	void push(T&& element)
+	{
+		publishPush(std::move(element));
+	}
+
+	// Pops the root into out, returns false if the heap was empty
+	bool try_pop(T& out)
+	{
+		Slot& slot = claimSlot();
+		serve(slot, POP_REQUEST);
+
+		bool popped = slot.popped;
+		if (popped)
+			out = std::move(slot.value);
+
+		slot.state.store(FREE_SLOT, std::memory_order_release);
+		return popped;
+	}
+
+	// Returns a copy of the root, throws Heap::HeapIsEmptyException if the heap is empty
+	T root()
+	{
+		std::lock_guard<SpinLock> guard(lock);
+		return heap.root();
+	}
+
+	std::size_t length()
+	{
+		std::lock_guard<SpinLock> guard(lock);
+		return heap.length();
+	}
+
+	bool isEmpty()
+	{
+		return length() == 0;
+	}
+
+private:
+	enum SlotState { FREE_SLOT, CLAIMED_SLOT, PUSH_REQUEST, POP_REQUEST, SERVED_SLOT };
+
+	struct alignas(CACHE_LINE_SIZE) Slot
+	{
+		Slot()
+		: state(FREE_SLOT)
+		, popped(false)
+		{
+		}
+
+		std::atomic<int> state;
+		T value;
+		bool popped;
+		// Set by the combiner when serving the request threw, rethrown by the requesting thread
+		std::exception_ptr error;
+	};
+
+	template <typename U>
+	void publishPush(U&& element)
+	{
+		Slot& slot = claimSlot();
+		try
+		{
+			slot.value = std::forward<U>(element);
+		}
+		catch (...)
+		{
+			slot.state.store(FREE_SLOT, std::memory_order_release);
+			throw;
+		}
+
+		serve(slot, PUSH_REQUEST);
+	}
+
+	// Claims a free slot, yielding after every pass over all the slots found none
+	Slot& claimSlot()
+	{
+		for (std::size_t i = randomShardNumber(), tried = 1;; ++i, ++tried)
+		{
+			Slot& slot = slots[i % slots.size()];
+			int expected = FREE_SLOT;
+			if (slot.state.load(std::memory_order_relaxed) == FREE_SLOT &&
+				slot.state.compare_exchange_strong(expected, CLAIMED_SLOT, std::memory_order_acquire))
+				return slot;
+
+			if (tried % slots.size() == 0)
+				std::this_thread::yield();
+		}
+	}
+
+	/* Publishes the request and waits until some combiner, possibly this thread, serves it.
+	 * Rethrows the exception serving the request threw, the slot is freed first.
+	 */
+	void serve(Slot& slot, SlotState request)
+	{
+		slot.state.store(request, std::memory_order_release);
+		while (slot.state.load(std::memory_order_acquire) != SERVED_SLOT)
+		{
+			std::unique_lock<SpinLock> guard(lock, std::try_to_lock);
+			if (guard.owns_lock())
+				combine();
+			else
+				std::this_thread::yield();
+		}
+
+		if (slot.error)
+		{
+			auto error = slot.error;
+			slot.error = nullptr;
+			slot.state.store(FREE_SLOT, std::memory_order_release);
+			std::rethrow_exception(error);
+		}
+
+		if (request == PUSH_REQUEST)
+			slot.state.store(FREE_SLOT, std::memory_order_release);
+	}
+
+	// Serves all the published requests, the pushes are linearized before the pops
+	void combine()
+	{
+		pushes.clear();
+		pops.clear();
+		for (auto& slot : slots)
+		{
+			int state = slot.state.load(std::memory_order_acquire);
+			if (state == PUSH_REQUEST)
+				pushes.push_back(&slot);
+			else if (state == POP_REQUEST)
+				pops.push_back(&slot);
+		}
+
+		// After a failure the rest of the pass is not attempted, its requests get the same exception
+		std::exception_ptr error;
+		try
+		{
+			batch.clear();
+			for (auto slot : pushes)
+				batch.push_back(std::move(slot->value));
+			heap.push_range(std::make_move_iterator(batch.begin()), std::make_move_iterator(batch.end()));
+		}
+		catch (...)
+		{
+			error = std::current_exception();
+		}
+
+		for (auto slot : pushes)
+			markServed(*slot, error);
+
+		for (auto slot : pops)
+		{
+			if (!error)
+			{
+				try
+				{
+					slot->popped = heap.try_pop(slot->value);
+				}
+				catch (...)
+				{
+					error = std::current_exception();
+				}
+			}
+
+			markServed(*slot, error);
+		}
+	}
+
+	void markServed(Slot& slot, const std::exception_ptr& error)
+	{
+		slot.error = error;
+		slot.state.store(SERVED_SLOT, std::memory_order_release);
+	}
+
+	std::vector<Slot, AlignedAllocator<Slot>> slots;
+	SpinLock lock;
+	Heap heap;
+
+	// Scratch space of the combiner, kept to avoid allocating on every pass
+	std::vector<Slot*> pushes;
+	std::vector<Slot*> pops;
+	std::vector<T> batch;
+};
+
+}
+
+#endif /* CONCURRENT_HEAP_H_ */
@@ -0,0 +1,419 @@
+/*
+ * external_sort.h
+ *
+ *  Sorts binary files of fixed-size POD records that do not fit in memory.
+ *
+ *  The input is cut into sorted runs by replacement selection through a DHeap, so a run is
+ *  about twice as long as the records that fit in the memory budget (longer on presorted input).
+ *  The runs are spilled to temporary files and merged fanIn at a time with kway_merge,
+ *  pass after pass, until a single merge writes the output file.
+ *
+ *  Usage: auto report = external_sort<Record>("input.bin", "output.bin", ExternalSortOptions());
+ */
+
+#ifndef EXTERNAL_SORT_H_
+#define EXTERNAL_SORT_H_
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "heap.h"
+#include "kway_merge.h"
+
+namespace AlgorithmsMaman14{
+
+struct ExternalSortOptions
+{
+	// Bytes of records kept in memory, by the replacement selection heap or by the merge buffers
+	std::size_t memoryBudget = 64 << 20;
+	// Most runs merged together by a single merge
+	std::size_t fanIn = 64;
+	// Directory of the temporary run files
+	std::string tempDirectory = ".";
+	// Number of sons of the replacement selection heap and of the merge heap
+	std::size_t numberOfSons = 4;
+};
+
+struct ExternalSortReport
+{
+	double megabytesPerSecond() const
+	{
+		return seconds > 0 ? bytes / (1024.0 * 1024.0) / seconds : 0;
+	}
+
+	std::size_t records = 0;
+	std::size_t bytes = 0;
+	// Runs written by replacement selection
+	std::size_t runs = 0;
+	// Merges over all the data, the last one writes the output
+	std::size_t mergePasses = 0;
+	double seconds = 0;
+};
+
+struct ExternalSortIOException : public std::runtime_error
+{
+	explicit ExternalSortIOException(const std::string& path) : std::runtime_error("external sort could not access " + path){}
+};
+
+// Reads a file of records through a buffer of bufferLength records
+template <typename T>
+class RecordReader
+{
+public:
+	RecordReader(const std::string& path, std::size_t bufferLength)
+	: file(path, std::ios::binary)
+	, path(path)
+	, buffer(std::max<std::size_t>(bufferLength, 1))
+	, current(0)
+	, loaded(0)
+	{
+		if (!file)
+			throw ExternalSortIOException(path);
+		fill();
+	}
+
+	bool isExhausted() const
+	{
+		return current == loaded;
+	}
+
+	const T& head() const
+	{
+		return buffer[current];
+	}
+
+	void advance()
+	{
+		if (++current == loaded)
+			fill();
+	}
+
+	// Input iterator over the remaining records, all the past the end iterators are equal
+	class iterator
+	{
+	public:
+		typedef std::input_iterator_tag iterator_category;
+		typedef T value_type;
+		typedef std::ptrdiff_t difference_type;
+		typedef const T* pointer;
+		typedef const T& reference;
+
+		explicit iterator(RecordReader* reader_ = nullptr)
+		: reader(reader_)
+		{
+		}
+
+		const T& operator*() const
+		{
+			return reader->head();
+		}
+
+		iterator& operator++()
+		{
+			reader->advance();
+			return *this;
+		}
+
+		bool operator==(const iterator& other) const
+		{
+			return isEnd() == other.isEnd();
+		}
+
+		bool operator!=(const iterator& other) const
+		{
+			return !(*this == other);
+		}
+
+	private:
+		bool isEnd() const
+		{
+			return reader == nullptr || reader->isExhausted();
+		}
+
+		RecordReader* reader;
+	};
+
+	iterator begin()
+	{
+		return iterator(this);
+	}
+
+	iterator end()
+	{
+		return iterator();
+	}
+
+private:
+	void fill()
+	{
+		file.read(reinterpret_cast<char*>(buffer.data()), buffer.size() * sizeof(T));
+		// A trailing partial record means the file is truncated or holds other records than T
+		if (file.bad() || file.gcount() % sizeof(T) != 0)
+			throw ExternalSortIOException(path);
+
+		current = 0;
+		loaded = file.gcount() / sizeof(T);
+	}
+
+	std::ifstream file;
+	std::string path;
+	std::vector<T> buffer;
+	std::size_t current;
+	std::size_t loaded;
+};
+
+// Writes records to a file through a buffer of bufferLength records
+template <typename T>
+class RecordWriter
+{
+public:
+	RecordWriter(const std::string& path, std::size_t bufferLength)
+	: file(path, std::ios::binary | std::ios::trunc)
+	, path(path)
+	, bufferLength(std::max<std::size_t>(bufferLength, 1))
+	{
+		if (!file)
+			throw ExternalSortIOException(path);
+		buffer.reserve(this->bufferLength);
+	}
+
+	~RecordWriter()
+	{
+		if (!buffer.empty())
+			file.write(reinterpret_cast<const char*>(buffer.data()), buffer.size() * sizeof(T));
+	}
+
+	void write(const T& record)
+	{
+		buffer.push_back(record);
+		if (buffer.size() == bufferLength)
+			flush();
+	}
+
+	void flush()
+	{
+		file.write(reinterpret_cast<const char*>(buffer.data()), buffer.size() * sizeof(T));
+		if (!file)
+			throw ExternalSortIOException(path);
+
+		buffer.clear();
+	}
+
+private:
+	std::ofstream file;
+	std::string path;
+	std::size_t bufferLength;
+	std::vector<T> buffer;
+};
+
+/* Cuts the input into sorted runs with replacement selection and spills every run to a temporary file.
+ * The heap holds the records tagged by the run they belong to. The root, the first record of the
+ * earliest run, is written out and replaced by the next input record; a record that comes before
+ * the one just written cannot join the current run anymore, so it is tagged for the next one.
+ */
+template <typename T, typename Compare, typename Projection>
+class RunGenerator
+{
+public:
+	struct KeyLess
+	{
+		bool operator()(const T& lhs, const T& rhs) const
+		{
+			return compare(projection(lhs), projection(rhs));
+		}
+
+		Compare compare;
+		Projection projection;
+	};
+
+	RunGenerator(const ExternalSortOptions& options_, const Compare& compare, const Projection& projection)
+	: options(options_)
+	, keyLess{compare, projection}
+	, runStamp(std::chrono::steady_clock::now().time_since_epoch().count())
+	, created(0)
+	{
+	}
+
+	// Removes the run files that are left, all of them when the sort failed
+	~RunGenerator()
+	{
+		for (std::size_t run = 0; run < created; ++run)
+			std::remove(runPath(run).c_str());
+	}
+
+	RunGenerator(const RunGenerator&) = delete;
+	RunGenerator& operator=(const RunGenerator&) = delete;
+
+	// Returns the paths of the runs
+	std::vector<std::string> generate(RecordReader<T>& input, ExternalSortReport& report)
+	{
+		// Half the budget goes to the heap, the rest to the reader and the writer
+		std::size_t heapLength = std::max<std::size_t>(options.memoryBudget / 2 / sizeof(TaggedRecord), 1);
+		std::size_t bufferLength = options.memoryBudget / 4 / sizeof(T);
+
+		std::vector<TaggedRecord> initial;
+		initial.reserve(heapLength);
+		for (; initial.size() < heapLength && !input.isExhausted(); input.advance())
+			initial.push_back(TaggedRecord{0, input.head()});
+
+		DHeap<TaggedRecord, std::vector<TaggedRecord>, RUNTIME_ARITY, RunOrder> heap(options.numberOfSons, orderBy(RunOrder{keyLess}), std::move(initial));
+
+		std::vector<std::string> runs;
+		while (!heap.isEmpty())
+		{
+			std::size_t run = heap.root().run;
+			runs.push_back(nextRunPath());
+			RecordWriter<T> writer(runs.back(), bufferLength);
+
+			while (!heap.isEmpty() && heap.root().run == run)
+			{
+				T written = heap.root().record;
+				writer.write(written);
+				++report.records;
+
+				if (input.isExhausted())
+				{
+					heap.pop();
+					continue;
+				}
+
+				std::size_t nextRun = keyLess(input.head(), written) ? run + 1 : run;
+				heap.replace_top(TaggedRecord{nextRun, input.head()});
+				input.advance();
+			}
+
+			writer.flush();
+		}
+
+		report.runs = runs.size();
+		return runs;
+	}
+
+	std::string nextRunPath()
+	{
+		return runPath(created++);
+	}
+
+	KeyLess keyOrder() const
+	{
+		return keyLess;
+	}
+
+private:
+	std::string runPath(std::size_t run) const
+	{
+		return options.tempDirectory + "/dheap_run_" + std::to_string(runStamp) + "_" + std::to_string(run) + ".tmp";
+	}
+
+	struct TaggedRecord
+	{
+		std::size_t run;
+		T record;
+	};
+
+	// The root is the first record of the earliest run
+	struct RunOrder
+	{
+		bool operator()(const TaggedRecord& lhs, const TaggedRecord& rhs) const
+		{
+			if (lhs.run != rhs.run)
+				return lhs.run > rhs.run;
+
+			return keyLess(rhs.record, lhs.record);
+		}
+
+		KeyLess keyLess;
+	};
+
+	const ExternalSortOptions& options;
+	KeyLess keyLess;
+	long long runStamp;
+	std::size_t created;
+
+};
+
+/* Merges the runs into the file output through a kway_merge over buffered readers.
+ * The memory budget is split evenly between the readers and the writer.
+ */
+template <typename T, typename KeyLess>
+void mergeRunFiles(const std::vector<std::string>& runs, const std::string& output,
+				   const ExternalSortOptions& options, const KeyLess& keyLess)
+{
+	std::size_t bufferLength = options.memoryBudget / (runs.size() + 1) / sizeof(T);
+
+	std::vector<std::unique_ptr<RecordReader<T>>> readers;
+	std::vector<std::pair<typename RecordReader<T>::iterator, typename RecordReader<T>::iterator>> ranges;
+	for (const auto& run : runs)
+	{
+		readers.emplace_back(new RecordReader<T>(run, bufferLength));
+		ranges.emplace_back(readers.back()->begin(), readers.back()->end());
+	}
+
+	RecordWriter<T> writer(output, bufferLength);
+	for (const auto& record : make_merge_range(ranges.begin(), ranges.end(), keyLess, options.numberOfSons))
+		writer.write(record);
+	writer.flush();
+}
+
+/* Sorts the records of the file input into the file output in ascending order by compare.
+ * T has to be a POD record, the files are read and written as arrays of T in the machine's representation.
+ * Throws ExternalSortIOException when a file cannot be opened, read or written, or when the input's length
+ * is not a multiple of sizeof(T). The temporary run files are removed either way.
+ */
+template <typename T, typename Compare = Less, typename Projection = Identity>
+ExternalSortReport external_sort(const std::string& input, const std::string& output, const ExternalSortOptions& options = ExternalSortOptions(),
+								 const Compare& compare = Compare(), const Projection& projection = Projection())
+{
+	static_assert(std::is_pod<T>::value, "external_sort sorts POD records only");
+	if (options.fanIn < 2)
+		throw std::invalid_argument("external sort has to merge at least 2 runs at a time");
+
+	ExternalSortReport report;
+	auto start = std::chrono::steady_clock::now();
+
+	RunGenerator<T, Compare, Projection> generator(options, compare, projection);
+	std::vector<std::string> runs;
+	{
+		RecordReader<T> reader(input, options.memoryBudget / 4 / sizeof(T));
+		runs = generator.generate(reader, report);
+	}
+	report.bytes = report.records * sizeof(T);
+
+	// Merging groups of fanIn runs into longer runs, until the last merge can write the output
+	while (runs.size() > options.fanIn)
+	{
+		std::vector<std::string> merged;
+		for (std::size_t first = 0; first < runs.size(); first += options.fanIn)
+		{
+			std::vector<std::string> group(runs.begin() + first, runs.begin() + std::min(first + options.fanIn, runs.size()));
+			merged.push_back(generator.nextRunPath());
+			mergeRunFiles<T>(group, merged.back(), options, generator.keyOrder());
+
+			for (const auto& run : group)
+				std::remove(run.c_str());
+		}
+
+		runs.swap(merged);
+		++report.mergePasses;
+	}
+
+	mergeRunFiles<T>(runs, output, options, generator.keyOrder());
+	++report.mergePasses;
+	for (const auto& run : runs)
+		std::remove(run.c_str());
+
+	report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return report;
+}
+
+}
+
+#endif /* EXTERNAL_SORT_H_ */
@@ -7,17 +7,205 @@
 
 #ifndef HEAP_H_
 #define HEAP_H_
+#include <algorithm>
 #include <iostream>
+#include <iterator>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 #include "heap_storage.h"
 
 using namespace std;
 namespace AlgorithmsMaman14{
 
-template <typename T, typename RandomAccessStorage = std::vector<T>>
+// Marks a heap whose number of sons is only known at runtime
+const std::size_t RUNTIME_ARITY = 0;
+
+// Heaps shorter than this are built on a single thread by build_max_heap(threads)
+const std::size_t PARALLEL_BUILD_MIN_LENGTH = 1 << 16;
+
+// Number of independent subtrees build_max_heap(threads) aims to give every thread
+const std::size_t PARALLEL_BUILD_SUBTREES_PER_THREAD = 4;
+
+/* Holds the number of sons of every node in the heap.
+ * A non-zero Sons makes the arity a compile-time constant, this lets the compiler
+ * replace the index arithmetic with shifts and unroll the scan over the sons.
+ */
+template <std::size_t Sons>
+class HeapArity
+{
+public:
+	struct ArityMismatchException : public std::invalid_argument { ArityMismatchException() : std::invalid_argument("number of sons does not match the heap's arity"){} };
+
+	explicit HeapArity(std::size_t numberOfSons)
+	{
+		if (numberOfSons != Sons)
+			throw ArityMismatchException();
+	}
+
+	std::size_t value() const
+	{
+		return Sons;
+	}
+};
+
+// The arity is kept as a data member when it is chosen at runtime.
+template <>
+class HeapArity<RUNTIME_ARITY>
+{
+public:
+	explicit HeapArity(std::size_t numberOfSons_)
+	: numberOfSons(numberOfSons_)
+	{
+	}
+
+	std::size_t value() const
+	{
+		return numberOfSons;
+	}
+
+private:
+	std::size_t numberOfSons;
+};
+
+/* The default ordering of DHeap, it has the meaning of std::less (lhs has a lower priority than rhs)
+ * but only requires operator> from the keys, like DHeap always did.
+ */
+struct Less
+{
+	template <typename Lhs, typename Rhs>
+	bool operator()(const Lhs& lhs, const Rhs& rhs) const
+	{
+		return rhs > lhs;
+	}
+};
+
+// The default projection of DHeap, every element is its own key
+struct Identity
+{
+	template <typename U>
+	const U& operator()(const U& obj) const
+	{
+		return obj;
+	}
+};
+
+/* Selects how heap sort restores the heap after moving the root to the sorted part.
+ * TOP_DOWN_SORT compares the sinking element against the largest son at every level.
+ * BOTTOM_UP_SORT (Floyd's variant) walks the largest sons down to a leaf and sifts the element
+ * back up from there, which saves about half the comparisons - worth it when comparing is expensive.
+ */
+enum SortStrategy
+{
+	TOP_DOWN_SORT,
+	BOTTOM_UP_SORT
+};
+
+// Bundles the comparator and projection objects that are passed to DHeap's constructor
+template <typename Compare, typename Projection = Identity>
+struct HeapOrder
+{
+	Compare compare;
+	Projection projection;
+};
+
+template <typename Compare, typename Projection = Identity>
+HeapOrder<Compare, Projection> orderBy(const Compare& compare, const Projection& projection = Projection())
+{
+	return HeapOrder<Compare, Projection>{compare, projection};
+}
+
+/* Passed to DHeap's constructor to attach to a storage that already holds a valid heap
+ * (e.g. a reopened MappedFileStorage), the heap is then not rebuilt.
+ */
+struct AttachHeap {};
+const AttachHeap ATTACH_HEAP = AttachHeap();
+
+/* The default son selection policy of DHeap, scans the sons one after the other.
+ * A selection policy returns the index of the son in [first, end) that outranks the rest,
+ * see BranchlessSelection below and simd_selection.h for a vectorized policy.
+ */
+struct ScanSelection
+{
+	template <typename Heap>
+	static std::size_t largestOf(const Heap& heap, std::size_t first, std::size_t end)
+	{
+		const auto& elements = heap.storage();
+		auto largest = first;
+		for (auto child = first + 1; child < end; ++child)
+			if (heap.outranks(elements[child], elements[largest]))
+				largest = child;
+
+		return largest;
+	}
+};
+
+/* Son selection policy that scans the sons without branching on the comparisons.
+ * On random keys the scan's "is this son larger" branch is mispredicted about half the time,
+ * here the comparison's result selects both the index and a copy of the largest son, which the
+ * compiler turns into conditional moves. Pays off for cheap comparisons of unpredictable keys,
+ * elements that are not trivially copyable (whose comparisons and copies are hardly cheap)
+ * are scanned by ScanSelection.
+ * Usage: DHeap<int, std::vector<int>, 4, Less, Identity, BranchlessSelection>
+ */
+struct BranchlessSelection
+{
+	template <typename Heap>
+	static std::size_t largestOf(const Heap& heap, std::size_t first, std::size_t end)
+	{
+		return largestOf(heap, first, end, std::is_trivially_copyable<typename Heap::ValueType>());
+	}
+
+private:
+	template <typename Heap>
+	static std::size_t largestOf(const Heap& heap, std::size_t first, std::size_t end, std::true_type)
+	{
+		const auto& elements = heap.storage();
+		auto largest = first;
+		// A copy of the largest son so far, so the next comparison does not wait for a load through largest
+		typename Heap::ValueType best = elements[first];
+		for (auto child = first + 1; child < end; ++child)
+		{
+			bool outranks = heap.outranks(elements[child], best);
+			largest = outranks ? child : largest;
+			best = outranks ? elements[child] : best;
+		}
+
+		return largest;
+	}
+
+	template <typename Heap>
+	static std::size_t largestOf(const Heap& heap, std::size_t first, std::size_t end, std::false_type)
+	{
+		return ScanSelection::largestOf(heap, first, end);
+	}
+};
+
+/* A d-ary heap over a random access storage.
+ *
+ * Elements are ordered by Compare(Projection(a), Projection(b)), in the same manner as
+ * std::priority_queue - the root is the element that no other element is "less" than.
+ * The defaults build a max heap over the elements themselves,
+ * std::greater builds a min heap and a Projection can order records by one of their members.
+ * SonSelection is the policy used to find the largest son of a node, see ScanSelection.
+ */
+template <typename T,
+		  typename RandomAccessStorage = std::vector<T>,
+		  std::size_t Sons = RUNTIME_ARITY,
+		  typename Compare = Less,
+		  typename Projection = Identity,
+		  typename SonSelection = ScanSelection>
 class DHeap
 {
 public:
+	typedef T ValueType;
+	typedef RandomAccessStorage StorageType;
+	typedef Compare CompareType;
+	typedef Projection ProjectionType;
+	static const std::size_t SONS = Sons;
+
 	/* The design allows placing specialized datastructures as storage.
 	 * Some of them requires different parameters for construction.
 	 * (e.g c-style array requires ArrayData)
@@ -26,26 +214,54 @@ public:
 	 */
 	template <typename... Args>
 	DHeap(std::size_t numberOfSons_, Args&&... args)
-	: numberOfSons(numberOfSons_)
+	: arity(numberOfSons_)
 	, data(std::forward<Args>(args)...)
 	{
 		// The API supports receiving a storage and converting it into a heap.
 		build_max_heap();
 	}
 
+	// Same as above, with comparator and projection objects (e.g. lambdas), see orderBy()
+	template <typename... Args>
+	DHeap(std::size_t numberOfSons_, HeapOrder<Compare, Projection> order, Args&&... args)
+	: arity(numberOfSons_)
+	, compare(order.compare)
+	, projection(order.projection)
+	, data(std::forward<Args>(args)...)
+	{
+		build_max_heap();
+	}
+
+	// Attaches to a storage that is already a valid heap in O(1), see AttachHeap
+	template <typename... Args>
+	DHeap(std::size_t numberOfSons_, AttachHeap, Args&&... args)
+	: arity(numberOfSons_)
+	, data(std::forward<Args>(args)...)
+	{
+	}
+
+	template <typename... Args>
+	DHeap(std::size_t numberOfSons_, HeapOrder<Compare, Projection> order, AttachHeap, Args&&... args)
+	: arity(numberOfSons_)
+	, compare(order.compare)
+	, projection(order.projection)
+	, data(std::forward<Args>(args)...)
+	{
+	}
+
 	/* This constructor is used to build a heap onto the DataStructure without
 	 * using the entire DataStructure.
 	 */
 	template <typename... Args>
 	DHeap(std::size_t numberOfSons_, std::size_t heapSize, Args&&... args)
-	: numberOfSons(numberOfSons_)
+	: arity(numberOfSons_)
 	, data(heapSize, std::forward<Args>(args)...)
 	{
 		// The API supports receiving a storage and converting it into a heap.
 		build_max_heap();
 	}
 
-	struct HeapIsEmptyException : public std::runtime_error { HeapIsEmptyException() : std::runtime_error("root method called on empty heap"){} };
+	struct HeapIsEmptyException : public std::runtime_error { HeapIsEmptyException() : std::runtime_error("root of an empty heap was accessed"){} };
 
 	// Allows accessing the heap's root element.
 	const T& root() const
@@ -56,14 +272,111 @@ public:
 		return *data[0];
 	}
 
-	/* Pushes a copy of obj into the heap
-	 * Proof of concept to support priority queue
-	 */
+	// Pushes a copy of obj into the heap
 	void push(const T& obj)
 	{
-		data.push(obj);
-		std::swap(*data[0], *data[data.length()]);
-		max_heapify(0);
+		emplace(obj);
+	}
+
+	// Pushes obj into the heap, obj is moved and left in a valid but unspecified state
+	void push(T&& obj)
+	{
+		emplace(std::move(obj));
+	}
+
+	// Constructs a new element at the bottom of the heap and moves it up to its place
+	template <typename... Args>
+	void emplace(Args&&... args)
+	{
+		emplaceImpl(DropsLowestWhenFull<RandomAccessStorage>(), std::forward<Args>(args)...);
+	}
+
+	/* Pushes the elements of [first, last) into the heap.
+	 * The whole batch is appended first and then fixed by the cheapest of, estimated in comparisons:
+	 * sifting every new element up - up to the height of the heap each,
+	 * re-heapifying the ancestors of the new elements - a son selection each,
+	 * or rebuilding the whole heap when the batch outnumbers the elements already in it.
+	 * When an append throws (e.g. HeapIsFullException of a fixed-capacity storage) the elements
+	 * appended so far stay in the heap, which is fixed before the exception is rethrown.
+	 */
+	template <typename InputIterator>
+	void push_range(InputIterator first, InputIterator last)
+	{
+		// A full storage that drops the lowest element needs every push to go through emplace
+		if (DropsLowestWhenFull<RandomAccessStorage>::value)
+		{
+			for (; first != last; ++first)
+				emplace(*first);
+			return;
+		}
+
+		auto oldLength = length();
+		try
+		{
+			for (; first != last; ++first)
+				data.emplace(*first);
+		}
+		catch (...)
+		{
+			heapifyAppended(oldLength);
+			throw;
+		}
+
+		heapifyAppended(oldLength);
+	}
+
+	// Removes the root from the heap, returning it to the caller
+	T pop()
+	{
+		if (isEmpty())
+			throw HeapIsEmptyException();
+
+		T top = std::move(*data[0]);
+		removeRoot();
+		return top;
+	}
+
+	// Same as pop(), but reports an empty heap by returning false instead of throwing
+	bool try_pop(T& out)
+	{
+		if (isEmpty())
+			return false;
+
+		out = std::move(*data[0]);
+		removeRoot();
+		return true;
+	}
+
+	/* Replaces the root with obj and returns the old root.
+	 * Costs a single sift down, instead of a pop followed by a push.
+	 */
+	T replace_top(const T& obj)
+	{
+		return replaceTopImpl(obj);
+	}
+
+	T replace_top(T&& obj)
+	{
+		return replaceTopImpl(std::move(obj));
+	}
+
+	/* Pushes obj and pops the root right after.
+	 * When obj would have become the root it is returned without touching the heap.
+	 */
+	T pushpop(const T& obj)
+	{
+		if (isEmpty() || !outranks(*data[0], obj))
+			return obj;
+
+		return replaceTopImpl(obj);
+	}
+
+	T pushpop(T&& obj)
+	{
+		if (isEmpty() || !outranks(*data[0], obj))
+			return std::move(obj);
+
+		return replaceTopImpl(std::move(obj));
 	}
 
 	bool isEmpty() const
@@ -79,6 +392,15 @@ public:
 		return data.data;
 	}
 
+	/*  Provides access to the storage itself, for the operations a storage adds of its own,
+	 *  e.g. MappedFileStorage's sync() and advise(). The heap's elements must not be reordered,
+	 *  added or removed through it.
+	 */
+	RandomAccessStorage& storage()
+	{
+		return data.data;
+	}
+
 	std::size_t length() const
 	{
 		return data.heapSize;
@@ -101,39 +423,310 @@ public:
 		max_heapify(0);
 	}
 
-	/* NOTE: After calling this method the heap will decrease it's size to one.
+	/* Removes the elements for which predicate returns true and rebuilds the heap from the rest
+	 * with build_max_heap(). predicate is called once for every element, returns the number of removed elements.
+	 */
+	template <typename Predicate>
+	std::size_t remove_if(Predicate predicate)
+	{
+		auto originalLength = length();
+		std::size_t kept = 0;
+		for (std::size_t i = 0; i < originalLength; ++i)
+		{
+			if (predicate(static_cast<const T&>(*data[i])))
+				continue;
+
+			if (kept != i)
+				place(kept, std::move(*data[i]));
+			++kept;
+		}
+
+		while (length() > kept)
+			data.pop();
+
+		build_max_heap();
+		return originalLength - kept;
+	}
+
+	/* Same as build_max_heap(), splitting the work between threads (the calling thread is one of them).
+	 * The subtrees below the first depth that has a few nodes per thread are independent of each other,
+	 * every thread heapifies its share of them and the levels above that depth are then fixed serially.
+	 * Heaps shorter than minParallelLength are not worth the threads and are built serially.
+	 */
+	void build_max_heap(std::size_t threads, std::size_t minParallelLength = PARALLEL_BUILD_MIN_LENGTH)
+	{
+		if (threads < 2 || length() < minParallelLength)
+			return build_max_heap();
+
+		// A few subtrees per thread even out the partial bottom level of the heap
+		std::size_t depthBegin = 0, depthLength = 1;
+		while (depthLength < threads * PARALLEL_BUILD_SUBTREES_PER_THREAD && firstChildOf(depthBegin) < length())
+		{
+			depthBegin = firstChildOf(depthBegin);
+			depthLength *= numberOfSons();
+		}
+
+		auto depthEnd = std::min(depthBegin + depthLength, length());
+		auto share = (depthEnd - depthBegin + threads - 1) / threads;
+
+		std::vector<std::thread> workers;
+		for (auto begin = depthBegin + share; begin < depthEnd; begin += share)
+			workers.emplace_back(&DHeap::heapifySubtrees, this, begin, std::min(begin + share, depthEnd));
+
+		heapifySubtrees(depthBegin, std::min(depthBegin + share, depthEnd));
+		for (auto& worker : workers)
+			worker.join();
+
+		for (auto i = depthBegin; i > 0; --i)
+			max_heapify(i - 1);
+	}
+
+	/* The strategy selects how the element replacing the root is sifted down,
+	 * see SortStrategy.
+	 *
+	 * NOTE: After calling this method the heap will decrease it's size to one.
 	 * (This is the smallest number of elements that represents a valid heap).
 	 * The stored data can be accessed via the storage() method.
 	 * The length of the sorted array is the number returned by the function.
 	 */
-	std::size_t sort()
+	std::size_t sort(SortStrategy strategy = TOP_DOWN_SORT)
 	{
 		auto originalLen = length();
 		if (length() > 1) // Does not need to do anything if one or zero elements.
-			sortImpl();
+			sortImpl(strategy);
 
 		return originalLen;
 	}
 
 
 protected:
-	// Corrects the heap property, returns whether the heap was changed or not
+	/* Corrects the heap property below parent.
+	 * The parent is lifted out once, larger sons are moved up into the hole it leaves
+	 * and the parent is written back once it reaches its place.
+	 */
 	void max_heapify(std::size_t parent)
 	{
-		std::size_t largest = parent;
+		auto largest = largestChildOf(parent);
+		if (largest >= length() || !outranks(*data[largest], *data[parent]))
+			return;
+
+		T sinking = std::move(*data[parent]);
+		place(parent, std::move(*data[largest]));
+		sift_down(largest, std::move(sinking));
+	}
+
+	/* Fills the hole at index with value, the hole is moved down the tree
+	 * while it has a son larger than value.
+	 */
+	template <typename U>
+	void sift_down(std::size_t hole, U&& value)
+	{
+		auto heapLength = length();
+		for (auto largest = largestChildOf(hole); largest < heapLength && outranks(*data[largest], value); largest = largestChildOf(hole))
+		{
+			place(hole, std::move(*data[largest]));
+			hole = largest;
+		}
+
+		place(hole, std::forward<U>(value));
+	}
+
+	/* Bottom-up variant of sift_down: the hole is moved down the path of the largest sons
+	 * all the way to a leaf without comparing them to value, then value rises from there.
+	 * value nearly always belongs near the leaves, so this takes about half the comparisons.
+	 */
+	template <typename U>
+	void sift_down_to_leaf(std::size_t hole, U&& value)
+	{
+		auto heapLength = length();
+		for (auto largest = largestChildOf(hole); largest < heapLength; largest = largestChildOf(hole))
+		{
+			place(hole, std::move(*data[largest]));
+			hole = largest;
+		}
+
+		sift_up(hole, std::forward<U>(value));
+	}
+
+	// Moves the node at index up the tree, until its parent is not smaller than it
+	void sift_up(std::size_t index)
+	{
+		if (index == 0 || !outranks(*data[index], *data[parentOf(index)]))
+			return;
+
+		T rising = std::move(*data[index]);
+		place(index, std::move(*data[parentOf(index)]));
+		sift_up(parentOf(index), std::move(rising));
+	}
+
+	// Fills the hole at index with value, the hole is moved up the tree while value outranks its parent
+	template <typename U>
+	void sift_up(std::size_t hole, U&& value)
+	{
+		while (hole > 0 && outranks(value, *data[parentOf(hole)]))
+		{
+			place(hole, std::move(*data[parentOf(hole)]));
+			hole = parentOf(hole);
+		}
+
+		place(hole, std::forward<U>(value));
+	}
+
+	// Writes value into slot, a storage that tracks placements is told about it, see TracksPlacements
+	template <typename U>
+	void place(std::size_t slot, U&& value)
+	{
+		*data[slot] = std::forward<U>(value);
+		notifyPlaced(TracksPlacements<RandomAccessStorage>(), slot);
+	}
+
+	void notifyPlaced(std::false_type, std::size_t)
+	{
+	}
+
+	void notifyPlaced(std::true_type, std::size_t slot)
+	{
+		data.placed(slot);
+	}
+
+	// Returns the son of parent holding the largest value, or length() if parent is a leaf
+	std::size_t largestChildOf(std::size_t parent) const
+	{
+		auto heapLength = length();
+		auto first = firstChildOf(parent);
+		if (first >= heapLength)
+			return heapLength;
+
+		auto end = std::min(first + numberOfSons(), heapLength);
+		return SonSelection::largestOf(*this, first, end);
+	}
+
+	/* Heapifies the subtrees rooted at [begin, end), which are all at the same depth.
+	 * The descendants of consecutive nodes at every depth below them are consecutive too,
+	 * so the subtrees are fixed level after level, from their bottom level up.
+	 */
+	void heapifySubtrees(std::size_t begin, std::size_t end)
+	{
+		auto lastParent = parentOf(length() - 1);
+
+		std::vector<std::pair<std::size_t, std::size_t>> levels;
+		for (; begin <= lastParent; begin = firstChildOf(begin), end = firstChildOf(end - 1) + numberOfSons())
+			levels.emplace_back(begin, std::min(end, lastParent + 1));
+
+		for (auto level = levels.rbegin(); level != levels.rend(); ++level)
+			for (auto i = level->second; i > level->first; --i)
+				max_heapify(i - 1);
+	}
+
+	template <typename... Args>
+	void emplaceImpl(std::false_type, Args&&... args)
+	{
+		data.emplace(std::forward<Args>(args)...);
+		sift_up(length() - 1);
+	}
+
+	/* A full storage makes room by dropping the lowest element, which is one of the leaves.
+	 * The new element takes the lowest leaf's place and rises from there, unless it is the lowest itself.
+	 */
+	template <typename... Args>
+	void emplaceImpl(std::true_type, Args&&... args)
+	{
+		if (!data.isFull())
+			return emplaceImpl(std::false_type(), std::forward<Args>(args)...);
+
+		T element(std::forward<Args>(args)...);
+		auto lowest = length() - 1;
+		for (auto leaf = length() > 1 ? parentOf(length() - 1) + 1 : 0; leaf < length(); ++leaf)
+			if (outranks(*data[lowest], *data[leaf]))
+				lowest = leaf;
+
+		if (outranks(element, *data[lowest]))
+			sift_up(lowest, std::move(element));
+	}
+
+	/* Counts the distinct ancestors of the nodes [begin, length()).
+	 * The ancestors of a range of nodes one generation up are a range too, the ranges may overlap.
+	 */
+	std::size_t ancestorsOf(std::size_t begin) const
+	{
+		std::size_t count = 0;
+		auto low = begin, high = length() - 1;
+		while (low > 0)
+		{
+			auto nextLow = parentOf(low), nextHigh = std::min(parentOf(high), low - 1);
+			count += nextHigh + 1 - nextLow;
+			low = nextLow;
+			high = nextHigh;
+		}
+
+		return count;
+	}
+
+	// Corrects the heap after the nodes [oldLength, length()) were appended to it, see push_range
+	void heapifyAppended(std::size_t oldLength)
+	{
+		auto added = length() - oldLength;
+		if (added == 0)
+			return;
+
+		if (added >= oldLength)
+			return build_max_heap();
+
+		std::size_t height = 0;
+		for (std::size_t levelEnd = 1; levelEnd < length(); levelEnd = firstChildOf(levelEnd - 1) + numberOfSons())
+			++height;
+
+		if (added * height <= ancestorsOf(oldLength) * numberOfSons())
+		{
+			for (auto i = oldLength; i < length(); ++i)
+				sift_up(i);
+		}
+		else
+			heapifyAncestorsOf(oldLength);
+	}
+
+	/* Corrects the heap after the nodes [begin, length()) were appended to it.
+	 * Only the ancestors of the new nodes may break the heap property, they are heapified
+	 * from the last up, so the subtrees below every ancestor are heaps by the time it is heapified.
+	 */
+	void heapifyAncestorsOf(std::size_t begin)
+	{
+		auto low = begin, high = length() - 1;
+		while (low > 0)
+		{
+			auto nextLow = parentOf(low), nextHigh = std::min(parentOf(high), low - 1);
+			for (auto i = nextHigh + 1; i > nextLow; --i)
+				max_heapify(i - 1);
 
-		// Looping all the parent's sons, finding the one with the largest value
-		for (auto child = beginChild(parent); child != endChild(); ++child)
-			if (*child > *data[largest])
-				largest = child.index();
+			low = nextLow;
+			high = nextHigh;
+		}
+	}
 
-		// Correcting the heap, swapping the parent with the biggest node
-		if (largest != parent)
+	// Fills the root with the last element of the heap and shrinks the heap by one
+	void removeRoot()
+	{
+		auto last = length() - 1;
+		if (last == 0)
 		{
-			std::swap(*data[largest], *data[parent]);
-			// a lower heap might have been broken, needs to get fixed
-			max_heapify(largest);
+			data.pop();
+			return;
 		}
+
+		T sinking = std::move(*data[last]);
+		data.pop();
+		sift_down(0, std::move(sinking));
+	}
+
+	template <typename U>
+	T replaceTopImpl(U&& obj)
+	{
+		if (isEmpty())
+			throw HeapIsEmptyException();
+
+		T top = std::move(*data[0]);
+		sift_down(0, std::forward<U>(obj));
+		return top;
 	}
 
 public:
@@ -144,7 +737,24 @@ public:
 		if (index == 0)
 			return 0;
 
-		return (index -1) / numberOfSons;
+		return (index -1) / numberOfSons();
+	}
+
+	// Returns whether lhs belongs above rhs in the heap
+	bool outranks(const T& lhs, const T& rhs) const
+	{
+		return compare(projection(rhs), projection(lhs));
+	}
+
+	// Returns the index of the first son of parent, the rest of the sons follow it.
+	std::size_t firstChildOf(std::size_t parent) const
+	{
+		return parent * numberOfSons() + 1;
+	}
+
+	std::size_t numberOfSons() const
+	{
+		return arity.value();
 	}
 
 	struct ChildEndIterator {};
@@ -153,7 +763,7 @@ public:
 	class ChildIterator
 	{
 	public:
-		ChildIterator(std::size_t parent_, std::size_t length_, DHeap<T, RandomAccessStorage>& heap_)
+		ChildIterator(std::size_t parent_, std::size_t length_, DHeap& heap_)
 		: parent(parent_)
 		, length(length_)
 		, heap(heap_)
@@ -164,7 +774,7 @@ public:
 
 		std::size_t childOf(std::size_t sonNumber) const
 		{
-			return parent * heap.numberOfSons + sonNumber + 1;
+			return parent * heap.numberOfSons() + sonNumber + 1;
 		}
 
 		void operator++()
@@ -198,7 +808,7 @@ public:
 
 		std::size_t parent;
 		std::size_t length;
-		DHeap<T, RandomAccessStorage>& heap;
+		DHeap& heap;
 		Child current;
 
 		void setValue()
@@ -209,7 +819,7 @@ public:
 
 		bool isValid()
 		{
-			return current.index < length && current.number < heap.numberOfSons;
+			return current.index < length && current.number < heap.numberOfSons();
 		}
 
 		void nextChild()
@@ -235,33 +845,169 @@ public:
 	}
 
 protected:
-	std::size_t numberOfSons;
+	HeapArity<Sons> arity;
+	Compare compare;
+	Projection projection;
 	DHeapData<T, RandomAccessStorage> data;
 
 public:
-	void sortImpl()
+	void sortImpl(SortStrategy strategy)
 	{
 		// Sorting is based on the heap sort algorithm.
 		// The heap property is kept in the range [0.. i]
 		// While the range [i..length() -1] gets sorted values.
 		for (std::size_t i = data.length() - 1; i >= 1; --i)
 		{
-			// Removing the biggest value from the heap at range [0 .. i - 1]
-			std::swap(*data[0], *data[i]);
+			// Removing the biggest value from the heap at range [0 .. i - 1],
+			// the value it replaces is sifted down from the root.
+			T sinking = std::move(*data[i]);
+			place(i, std::move(*data[0]));
 			data.heapSize--;
-			max_heapify(0);
+			if (strategy == BOTTOM_UP_SORT)
+				sift_down_to_leaf(0, std::move(sinking));
+			else
+				sift_down(0, std::move(sinking));
 		}
 	}
 };
 
-template <typename T>
-void heap_sort(std::size_t numberOfSons, std::vector<T>& storage)
+/* A heap over a buffer it does not own, e.g. memory from mmap or a network receive, or a slice of a vector.
+ * The heap uses the first length elements of the buffer and can grow up to capacity elements,
+ * pushing into a full buffer throws HeapIsFullException.
+ * Usage: DHeapView<Request> heap(4, buffer, capacity, received);
+ */
+template <typename T,
+		  std::size_t Sons = RUNTIME_ARITY,
+		  typename Compare = Less,
+		  typename Projection = Identity,
+		  typename SonSelection = ScanSelection>
+class DHeapView : public DHeap<T, T*, Sons, Compare, Projection, SonSelection>
+{
+	typedef DHeap<T, T*, Sons, Compare, Projection, SonSelection> Base;
+
+public:
+	// Builds a heap of all the elements of the buffer
+	DHeapView(std::size_t numberOfSons, T* elements, std::size_t length)
+	: Base(numberOfSons, ArrayData<T>(elements, length))
+	{
+	}
+
+	// Builds a heap of the first length elements of the buffer
+	DHeapView(std::size_t numberOfSons, T* elements, std::size_t capacity, std::size_t length)
+	: Base(numberOfSons, ArrayData<T>(elements, capacity, length))
+	{
+	}
+
+	DHeapView(std::size_t numberOfSons, HeapOrder<Compare, Projection> order, T* elements, std::size_t length)
+	: Base(numberOfSons, order, ArrayData<T>(elements, length))
+	{
+	}
+
+	DHeapView(std::size_t numberOfSons, HeapOrder<Compare, Projection> order, T* elements, std::size_t capacity, std::size_t length)
+	: Base(numberOfSons, order, ArrayData<T>(elements, capacity, length))
+	{
+	}
+
+	// Attaches to the first length elements of the buffer, which are already a valid heap, see AttachHeap
+	DHeapView(std::size_t numberOfSons, AttachHeap attach, T* elements, std::size_t capacity, std::size_t length)
+	: Base(numberOfSons, attach, ArrayData<T>(elements, capacity, length))
+	{
+	}
+
+	DHeapView(std::size_t numberOfSons, HeapOrder<Compare, Projection> order, AttachHeap attach, T* elements, std::size_t capacity, std::size_t length)
+	: Base(numberOfSons, order, attach, ArrayData<T>(elements, capacity, length))
+	{
+	}
+};
+
+/* Sorts the array with a heap whose number of sons is known at compile time.
+ * The array is sorted in ascending order by compare, std::greater sorts in descending order.
+ */
+template <std::size_t Sons, typename SonSelection = ScanSelection, typename T, typename Compare = Less, typename Projection = Identity>
+void heap_sort(ArrayData<T> array, const Compare& compare = Compare(), const Projection& projection = Projection(),
+			   SortStrategy strategy = TOP_DOWN_SORT)
+{
+	DHeap<T, T*, Sons, Compare, Projection, SonSelection> heap(Sons, orderBy(compare, projection), array);
+	heap.sort(strategy);
+}
+
+template <std::size_t Sons, typename SonSelection = ScanSelection, typename T, typename Compare = Less, typename Projection = Identity>
+void heap_sort(std::vector<T>& storage, const Compare& compare = Compare(), const Projection& projection = Projection(),
+			   SortStrategy strategy = TOP_DOWN_SORT)
 {
 	// We want to edit the given data, using the array version of the heap for that.
-	ArrayData<T> array(&storage[0], storage.size());
-	DHeap<T, T*> heap(numberOfSons, array);
-//	DHeap<T> heap(numberOfSons, storage);
-	heap.sort();
+	heap_sort<Sons, SonSelection>(ArrayData<T>(storage.data(), storage.size()), compare, projection, strategy);
+}
+
+/* Dispatches the runtime number of sons to a compile-time heap when a
+ * specialization exists for it, falling back to the runtime arity heap otherwise.
+ */
+template <typename SonSelection = ScanSelection, typename T, typename Compare = Less, typename Projection = Identity>
+void heap_sort(std::size_t numberOfSons, ArrayData<T> array,
+			   const Compare& compare = Compare(), const Projection& projection = Projection(),
+			   SortStrategy strategy = TOP_DOWN_SORT)
+{
+	switch (numberOfSons)
+	{
+	case 2: return heap_sort<2, SonSelection>(array, compare, projection, strategy);
+	case 3: return heap_sort<3, SonSelection>(array, compare, projection, strategy);
+	case 4: return heap_sort<4, SonSelection>(array, compare, projection, strategy);
+	case 5: return heap_sort<5, SonSelection>(array, compare, projection, strategy);
+	case 8: return heap_sort<8, SonSelection>(array, compare, projection, strategy);
+	case 16: return heap_sort<16, SonSelection>(array, compare, projection, strategy);
+	}
+
+	DHeap<T, T*, RUNTIME_ARITY, Compare, Projection, SonSelection> heap(numberOfSons, orderBy(compare, projection), array);
+	heap.sort(strategy);
+}
+
+template <typename SonSelection = ScanSelection, typename T, typename Compare = Less, typename Projection = Identity>
+void heap_sort(std::size_t numberOfSons, std::vector<T>& storage,
+			   const Compare& compare = Compare(), const Projection& projection = Projection(),
+			   SortStrategy strategy = TOP_DOWN_SORT)
+{
+	heap_sort<SonSelection>(numberOfSons, ArrayData<T>(storage.data(), storage.size()), compare, projection, strategy);
+}
+
+template <std::size_t Sons, typename SonSelection = ScanSelection, typename RandomAccessIterator, typename Compare = Less, typename Projection = Identity>
+void heap_sort(RandomAccessIterator first, RandomAccessIterator last, const Compare& compare = Compare(), const Projection& projection = Projection(),
+			   SortStrategy strategy = TOP_DOWN_SORT)
+{
+	typedef typename std::iterator_traits<RandomAccessIterator>::value_type T;
+
+	DHeap<T, IteratorRange<RandomAccessIterator>, Sons, Compare, Projection, SonSelection> heap(Sons, orderBy(compare, projection), IteratorRange<RandomAccessIterator>(first, last));
+	heap.sort(strategy);
+}
+
+/* Sorts [first, last) in place, e.g. a std::array, a slice of a vector or a std::deque.
+ * Like the other heap_sort overloads, a number of sons with a compile-time heap is dispatched to it.
+ */
+template <typename SonSelection = ScanSelection, typename RandomAccessIterator, typename Compare = Less, typename Projection = Identity>
+void heap_sort(RandomAccessIterator first, RandomAccessIterator last, std::size_t numberOfSons,
+			   const Compare& compare = Compare(), const Projection& projection = Projection(),
+			   SortStrategy strategy = TOP_DOWN_SORT)
+{
+	typedef typename std::iterator_traits<RandomAccessIterator>::value_type T;
+
+	switch (numberOfSons)
+	{
+	case 2: return heap_sort<2, SonSelection>(first, last, compare, projection, strategy);
+	case 3: return heap_sort<3, SonSelection>(first, last, compare, projection, strategy);
+	case 4: return heap_sort<4, SonSelection>(first, last, compare, projection, strategy);
+	case 5: return heap_sort<5, SonSelection>(first, last, compare, projection, strategy);
+	case 8: return heap_sort<8, SonSelection>(first, last, compare, projection, strategy);
+	case 16: return heap_sort<16, SonSelection>(first, last, compare, projection, strategy);
+	}
+
+	DHeap<T, IteratorRange<RandomAccessIterator>, RUNTIME_ARITY, Compare, Projection, SonSelection> heap(numberOfSons, orderBy(compare, projection), IteratorRange<RandomAccessIterator>(first, last));
+	heap.sort(strategy);
+}
+
+// Sorts with the default ordering, using the given strategy
+template <typename SonSelection = ScanSelection, typename T>
+void heap_sort(std::size_t numberOfSons, std::vector<T>& storage, SortStrategy strategy)
+{
+	heap_sort<SonSelection>(numberOfSons, storage, Less(), Identity(), strategy);
 }
 
 }
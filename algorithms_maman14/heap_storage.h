@@ -1,10 +1,19 @@
 #ifndef HEAP_ALGS
 #define HEAP_ALGS
+#include <cstdint>
 #include <iostream>
+#include <iterator>
+#include <new>
 #include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 namespace AlgorithmsMaman14{
 
+// Thrown by the fixed-capacity storages (arrays, iterator ranges, InlineStorage) on a push into a full heap
+struct HeapIsFullException : public std::runtime_error { HeapIsFullException() : std::runtime_error("push into a full heap"){} };
+
 // Helper class for storing metadata about the array storage for the heap
 template <typename T>
 struct ArrayData
@@ -29,6 +38,33 @@ struct ArrayData
 };
 
 
+/* Whether a full storage makes room for a push by dropping the lowest element of the heap.
+ * The lowest element is only known to the heap, so DHeap drops it, see InlineStorage.
+ */
+template <typename RandomAccessStorage>
+struct DropsLowestWhenFull : public std::false_type {};
+
+/* Whether the elements [0, size()) of a storage are laid out one after the other in memory,
+ * so &storage[i] + 1 == &storage[i + 1]. Son selections that load whole families of sons
+ * from memory (SimdSelection) require it, other storages fall back to a plain scan.
+ */
+template <typename RandomAccessStorage>
+struct IsContiguousStorage : public std::false_type {};
+
+template <typename T>
+struct IsContiguousStorage<T*> : public std::true_type {};
+
+template <typename T, typename Allocator>
+struct IsContiguousStorage<std::vector<T, Allocator>> : public std::true_type {};
+
+/* Whether a storage keeps track of where the heap places its elements. DHeap then calls
+ * data.placed(slot) after every element it moves or writes into slot, e.g. so the storage
+ * can keep a map from its elements to their slots, see IndexedDHeap.
+ * Elements appended by data.emplace() are not reported, the storage places them itself.
+ */
+template <typename RandomAccessStorage>
+struct TracksPlacements : public std::false_type {};
+
 /*
  * This represents an underlying data holder for the Dheap class.
  * It is required to have random access operator enabled.
@@ -92,10 +128,25 @@ public:
 		return heapSize;
 	}
 
-	void push(const T& obj)
+	// Adds a new element right after the last element of the heap
+	template <typename... Args>
+	void emplace(Args&&... args)
+	{
+		// Slots past the heap (e.g. the sorted part left by sort()) are reused before growing the storage
+		if (heapSize < data.size())
+			data[heapSize] = T(std::forward<Args>(args)...);
+		else
+			data.emplace_back(std::forward<Args>(args)...);
+
+		++heapSize;
+	}
+
+	// Removes the last element of the heap
+	void pop()
 	{
-		data.push_back(obj);
-		heapSize = data.size();
+		--heapSize;
+		if (heapSize + 1 == data.size())
+			data.pop_back();
 	}
 
 	RandomAccessStorage data;
@@ -113,7 +164,7 @@ public:
 	DHeapData(ArrayData<T> array)
 	: data(array.array)
 	, heapSize(array.heapSize)
-	, arraySize(array.heapSize)
+	, arraySize(array.arrayLength)
 	{
 	}
 
@@ -132,15 +183,24 @@ public:
 		return heapSize;
 	}
 
-	struct HeapIsFullException : public std::runtime_error { HeapIsFullException() : std::runtime_error("push into a full heap"){} };
+	// The name heaps over arrays have always thrown, see AlgorithmsMaman14::HeapIsFullException
+	typedef AlgorithmsMaman14::HeapIsFullException HeapIsFullException;
 
-	void push(const T& obj)
+	// Adds a new element right after the last element of the heap
+	template <typename... Args>
+	void emplace(Args&&... args)
 	{
 		if (heapSize >= arraySize)
 			throw HeapIsFullException();
 
+		data[heapSize] = T(std::forward<Args>(args)...);
 		++heapSize;
-		*this->operator [](heapSize) = obj;
+	}
+
+	// Removes the last element of the heap, the array keeps owning its (moved from) object
+	void pop()
+	{
+		--heapSize;
 	}
 
 	const T* storage() const
@@ -155,6 +215,205 @@ protected:
 	std::size_t arraySize;
 };
 
+
+/* A random access range [first, last) that is not owned by the heap,
+ * e.g. a slice of a vector, a std::deque or a std::array.
+ */
+template <typename RandomAccessIterator>
+class IteratorRange
+{
+public:
+	typedef typename std::iterator_traits<RandomAccessIterator>::reference Reference;
+
+	IteratorRange(RandomAccessIterator first_, RandomAccessIterator last_)
+	: first(first_)
+	, last(last_)
+	{
+	}
+
+	Reference operator[] (std::size_t index) const
+	{
+		return first[index];
+	}
+
+	std::size_t size() const
+	{
+		return last - first;
+	}
+
+private:
+	RandomAccessIterator first;
+	RandomAccessIterator last;
+};
+
+template <typename T>
+struct IsContiguousStorage<IteratorRange<T*>> : public std::true_type {};
+
+/*
+ * Template specialization of DHeapData for heaps over an IteratorRange.
+ * Like the c-style array heap, the range's length is fixed and the heap may use a prefix of it.
+ */
+template <typename T, typename RandomAccessIterator>
+class DHeapData<T, IteratorRange<RandomAccessIterator>>
+{
+public:
+	DHeapData(IteratorRange<RandomAccessIterator> range)
+	: data(range)
+	, heapSize(range.size())
+	{
+	}
+
+	DHeapData(IteratorRange<RandomAccessIterator> range, std::size_t heapSize_)
+	: data(range)
+	, heapSize(heapSize_)
+	{
+	}
+
+	const T* operator[] (std::size_t location) const
+	{
+		return &data[location];
+	}
+
+	T* operator[] (std::size_t location)
+	{
+		return &data[location];
+	}
+
+	size_t length() const
+	{
+		return heapSize;
+	}
+
+	// Adds a new element right after the last element of the heap
+	template <typename... Args>
+	void emplace(Args&&... args)
+	{
+		if (heapSize >= data.size())
+			throw HeapIsFullException();
+
+		data[heapSize] = T(std::forward<Args>(args)...);
+		++heapSize;
+	}
+
+	// Removes the last element of the heap, the range keeps its (moved from) object
+	void pop()
+	{
+		--heapSize;
+	}
+
+	IteratorRange<RandomAccessIterator> data;
+	std::size_t heapSize;
+};
+
+
+const std::size_t CACHE_LINE_SIZE = 64;
+
+/* Allocator that places every allocation on an Alignment boundary (a cache line by default).
+ * The address returned by operator new is kept right before the aligned block.
+ */
+template <typename T, std::size_t Alignment = CACHE_LINE_SIZE>
+struct AlignedAllocator
+{
+	typedef T value_type;
+
+	template <typename U>
+	struct rebind { typedef AlignedAllocator<U, Alignment> other; };
+
+	AlignedAllocator() {}
+
+	template <typename U>
+	AlignedAllocator(const AlignedAllocator<U, Alignment>&) {}
+
+	T* allocate(std::size_t n)
+	{
+		void* raw = ::operator new(n * sizeof(T) + Alignment + sizeof(void*));
+		auto address = reinterpret_cast<std::uintptr_t>(raw) + sizeof(void*);
+		address = (address + Alignment - 1) & ~static_cast<std::uintptr_t>(Alignment - 1);
+		reinterpret_cast<void**>(address)[-1] = raw;
+		return reinterpret_cast<T*>(address);
+	}
+
+	void deallocate(T* p, std::size_t)
+	{
+		::operator delete(reinterpret_cast<void**>(p)[-1]);
+	}
+};
+
+template <typename T, typename U, std::size_t Alignment>
+bool operator==(const AlignedAllocator<T, Alignment>&, const AlignedAllocator<U, Alignment>&) { return true; }
+
+template <typename T, typename U, std::size_t Alignment>
+bool operator!=(const AlignedAllocator<T, Alignment>&, const AlignedAllocator<U, Alignment>&) { return false; }
+
+/*
+ * Vector storage for a DHeap with Sons sons, laid out so the sons of every node start on a cache line.
+ *
+ * The sons of node i are at i * Sons + 1 .. i * Sons + Sons, placing the root at slot Sons - 1
+ * of a cache line aligned buffer moves them to slots (i + 1) * Sons.
+ * When Sons * sizeof(T) is a power of two up to a cache line (or a multiple of it) a family of sons
+ * never straddles two cache lines, so sifting costs one cache miss per level.
+ *
+ * Indexes are the heap's indexes, the padding slots before the root are hidden.
+ * Usage: DHeap<int, SiblingAlignedVector<int, 16>, 16>
+ */
+template <typename T, std::size_t Sons, std::size_t CacheLine = CACHE_LINE_SIZE>
+class SiblingAlignedVector
+{
+public:
+	static_assert(Sons > 0, "the sibling aligned layout requires a compile-time number of sons");
+
+	static const std::size_t ROOT_SLOT = Sons - 1;
+
+	SiblingAlignedVector()
+	: slots(ROOT_SLOT)
+	{
+	}
+
+	template <typename InputIterator>
+	SiblingAlignedVector(InputIterator first, InputIterator last)
+	: slots(ROOT_SLOT)
+	{
+		slots.insert(slots.end(), first, last);
+	}
+
+	const T& operator[] (std::size_t index) const
+	{
+		return slots[index + ROOT_SLOT];
+	}
+
+	T& operator[] (std::size_t index)
+	{
+		return slots[index + ROOT_SLOT];
+	}
+
+	std::size_t size() const
+	{
+		return slots.size() - ROOT_SLOT;
+	}
+
+	void reserve(std::size_t capacity)
+	{
+		slots.reserve(capacity + ROOT_SLOT);
+	}
+
+	template <typename... Args>
+	void emplace_back(Args&&... args)
+	{
+		slots.emplace_back(std::forward<Args>(args)...);
+	}
+
+	void pop_back()
+	{
+		slots.pop_back();
+	}
+
+private:
+	std::vector<T, AlignedAllocator<T, CacheLine>> slots;
+};
+
+template <typename T, std::size_t Sons, std::size_t CacheLine>
+struct IsContiguousStorage<SiblingAlignedVector<T, Sons, CacheLine>> : public std::true_type {};
+
 }
 
 #endif
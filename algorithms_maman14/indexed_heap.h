@@ -0,0 +1,313 @@
+/*
+ * indexed_heap.h
+ *
+ *  An addressable d-ary heap.
+ *
+ *  Every pushed element gets a handle, the heap keeps a position map from the handles to the slots
+ *  of their elements. IndexedDHeap is a DHeap over an IndexedStorage, which tracks the placements
+ *  of DHeap's sift routines (see TracksPlacements) to keep the map up to date. With the map an element
+ *  can be reached in O(1), so its priority can be changed or it can be erased in O(d log_d n).
+ *
+ *  Usage: auto handle = heap.push(element); ... heap.update(handle, changed); ... heap.erase(handle);
+ */
+
+#ifndef INDEXED_HEAP_H_
+#define INDEXED_HEAP_H_
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "heap.h"
+
+namespace AlgorithmsMaman14{
+
+// An element of an IndexedDHeap and the handle it was pushed with
+template <typename T>
+struct IndexedEntry
+{
+	T value;
+	std::size_t handle;
+};
+
+// Projects an IndexedEntry by projecting its element, so the entries are ordered as their elements are
+template <typename Projection>
+struct EntryProjection
+{
+	template <typename T>
+	auto operator()(const IndexedEntry<T>& entry) const -> decltype(std::declval<const Projection&>()(entry.value))
+	{
+		return projection(entry.value);
+	}
+
+	Projection projection;
+};
+
+/* The storage of an IndexedDHeap: the entries, one after the other,
+ * and positions[handle] - the slot of handle's entry, or NOT_IN_HEAP.
+ */
+template <typename T>
+struct IndexedStorage
+{
+	static const std::size_t NOT_IN_HEAP = static_cast<std::size_t>(-1);
+
+	const IndexedEntry<T>& operator[] (std::size_t index) const
+	{
+		return entries[index];
+	}
+
+	IndexedEntry<T>& operator[] (std::size_t index)
+	{
+		return entries[index];
+	}
+
+	std::size_t size() const
+	{
+		return entries.size();
+	}
+
+	std::vector<IndexedEntry<T>> entries;
+	std::vector<std::size_t> positions;
+};
+
+template <typename T>
+const std::size_t IndexedStorage<T>::NOT_IN_HEAP;
+
+template <typename T>
+struct IsContiguousStorage<IndexedStorage<T>> : public std::true_type {};
+
+template <typename T>
+struct TracksPlacements<IndexedStorage<T>> : public std::true_type {};
+
+/*
+ * Template specialization of DHeapData for heaps kept in an IndexedStorage.
+ * Every placement of an entry, by DHeap or by emplace, is recorded in the position map.
+ */
+template <typename T>
+class DHeapData<IndexedEntry<T>, IndexedStorage<T>>
+{
+public:
+	DHeapData()
+	: heapSize(0)
+	{
+	}
+
+	const IndexedEntry<T>* operator[] (std::size_t location) const
+	{
+		return &data[location];
+	}
+
+	IndexedEntry<T>* operator[] (std::size_t location)
+	{
+		return &data[location];
+	}
+
+	size_t length() const
+	{
+		return heapSize;
+	}
+
+	// Adds a new entry right after the last entry of the heap
+	template <typename... Args>
+	void emplace(Args&&... args)
+	{
+		data.entries.emplace_back(std::forward<Args>(args)...);
+		placed(heapSize);
+		++heapSize;
+	}
+
+	// Removes the last entry of the heap, its handle is released by IndexedDHeap
+	void pop()
+	{
+		data.entries.pop_back();
+		--heapSize;
+	}
+
+	// Called by DHeap after it moved an entry into slot
+	void placed(std::size_t slot)
+	{
+		data.positions[data.entries[slot].handle] = slot;
+	}
+
+	IndexedStorage<T> data;
+	std::size_t heapSize;
+};
+
+/* A d-ary heap of elements that are addressed by handles, ordered as DHeap orders them.
+ * A handle is valid from the push that returned it until its element is popped or erased,
+ * after that the handle may be handed out again by a later push.
+ * The sons are selected by SonSelection, as in DHeap.
+ */
+template <typename T,
+		  std::size_t Sons = RUNTIME_ARITY,
+		  typename Compare = Less,
+		  typename Projection = Identity,
+		  typename SonSelection = ScanSelection>
+class IndexedDHeap : protected DHeap<IndexedEntry<T>, IndexedStorage<T>, Sons, Compare, EntryProjection<Projection>, SonSelection>
+{
+	typedef DHeap<IndexedEntry<T>, IndexedStorage<T>, Sons, Compare, EntryProjection<Projection>, SonSelection> Base;
+	typedef IndexedEntry<T> Entry;
+
+public:
+	typedef T ValueType;
+	typedef std::size_t Handle;
+	typedef typename Base::HeapIsEmptyException HeapIsEmptyException;
+
+	struct InvalidHandleException : public std::invalid_argument { InvalidHandleException() : std::invalid_argument("handle does not refer to an element of the heap"){} };
+
+	explicit IndexedDHeap(std::size_t numberOfSons, HeapOrder<Compare, Projection> order = HeapOrder<Compare, Projection>())
+	: Base(numberOfSons, orderBy(order.compare, EntryProjection<Projection>{order.projection}))
+	{
+	}
+
+	using Base::isEmpty;
+	using Base::length;
+	using Base::numberOfSons;
+
+	// Pushes a copy of obj into the heap, returns the handle of the new element
+	Handle push(const T& obj)
+	{
+		return pushImpl(obj);
+	}
+
+	Handle push(T&& obj)
+	{
+		return pushImpl(std::move(obj));
+	}
+
+	const T& root() const
+	{
+		return Base::root().value;
+	}
+
+	Handle rootHandle() const
+	{
+		return Base::root().handle;
+	}
+
+	// Removes the root from the heap, returning it to the caller
+	T pop()
+	{
+		Entry top = Base::pop();
+		release(top.handle);
+		return std::move(top.value);
+	}
+
+	// Same as pop(), but reports an empty heap by returning false instead of throwing
+	bool try_pop(T& out)
+	{
+		if (isEmpty())
+			return false;
+
+		out = pop();
+		return true;
+	}
+
+	bool contains(Handle handle) const
+	{
+		return handle < positions().size() && positions()[handle] != IndexedStorage<T>::NOT_IN_HEAP;
+	}
+
+	const T& value(Handle handle) const
+	{
+		return this->storage()[positionOf(handle)].value;
+	}
+
+	/* Replaces the element of handle with obj, the element is moved up or down the tree
+	 * depending on whether obj outranks the old element (increase or decrease key).
+	 */
+	void update(Handle handle, const T& obj)
+	{
+		updateImpl(handle, obj);
+	}
+
+	void update(Handle handle, T&& obj)
+	{
+		updateImpl(handle, std::move(obj));
+	}
+
+	// Removes the element of handle from the heap
+	void erase(Handle handle)
+	{
+		removeAt(positionOf(handle));
+	}
+
+	bool outranks(const T& lhs, const T& rhs) const
+	{
+		return this->compare(this->projection.projection(rhs), this->projection.projection(lhs));
+	}
+
+private:
+	template <typename U>
+	Handle pushImpl(U&& obj)
+	{
+		Handle handle;
+		if (freeHandles.empty())
+		{
+			handle = positions().size();
+			this->data.data.positions.push_back(IndexedStorage<T>::NOT_IN_HEAP);
+		}
+		else
+		{
+			handle = freeHandles.back();
+			freeHandles.pop_back();
+		}
+
+		Base::push(Entry{std::forward<U>(obj), handle});
+		return handle;
+	}
+
+	template <typename U>
+	void updateImpl(Handle handle, U&& obj)
+	{
+		auto hole = positionOf(handle);
+		Entry updated{std::forward<U>(obj), handle};
+		if (Base::outranks(updated, *this->data[hole]))
+			this->sift_up(hole, std::move(updated));
+		else
+			this->sift_down(hole, std::move(updated));
+	}
+
+	const std::vector<std::size_t>& positions() const
+	{
+		return this->storage().positions;
+	}
+
+	std::size_t positionOf(Handle handle) const
+	{
+		if (!contains(handle))
+			throw InvalidHandleException();
+
+		return positions()[handle];
+	}
+
+	// The handle's element left the heap, the handle may be handed out again
+	void release(Handle handle)
+	{
+		this->data.data.positions[handle] = IndexedStorage<T>::NOT_IN_HEAP;
+		freeHandles.push_back(handle);
+	}
+
+	/* Removes the element at hole, its handle is released.
+	 * The last element fills the hole and is moved up or down from there.
+	 */
+	void removeAt(std::size_t hole)
+	{
+		release(this->storage()[hole].handle);
+
+		Entry last = std::move(*this->data[length() - 1]);
+		this->data.pop();
+		if (hole == length())
+			return;
+
+		if (hole > 0 && Base::outranks(last, *this->data[this->parentOf(hole)]))
+			this->sift_up(hole, std::move(last));
+		else
+			this->sift_down(hole, std::move(last));
+	}
+
+	std::vector<Handle> freeHandles;
+};
+
+}
+
+#endif /* INDEXED_HEAP_H_ */
@@ -0,0 +1,156 @@
+/*
+ * indirect_sort.h
+ *
+ *  Heap sort for large records.
+ *
+ *  heap_sort moves whole records at every level of every sift, for records of hundreds of bytes the
+ *  moves cost more than the comparisons. indirect_heap_sort heap sorts compact (key, index) pairs instead
+ *  and then moves every record once, to its place in the sorted order.
+ *  Equal keys keep their original order, the index breaks the ties, so the indirect sort is stable.
+ *
+ *  Usage: indirect_heap_sort(4, records, std::less<std::uint64_t>(), KeyOf());
+ *         auto order = sort_permutation(4, records, ...); // records[order[0]] is the lowest record
+ */
+
+#ifndef INDIRECT_SORT_H_
+#define INDIRECT_SORT_H_
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "heap.h"
+
+namespace AlgorithmsMaman14{
+
+/* Selects how indirect_heap_sort moves the records into the sorted order.
+ * CYCLE_PERMUTATION follows the cycles of the permutation in place, every record is moved once
+ * (plus one extra move per cycle) and no extra memory is needed.
+ * GATHER_PERMUTATION moves the records in sorted order into a new buffer, which replaces the old one.
+ * The reads are random but the writes are sequential, at the cost of a second buffer of records.
+ */
+enum PermutationStrategy
+{
+	CYCLE_PERMUTATION,
+	GATHER_PERMUTATION
+};
+
+struct TooManyRecordsException : public std::invalid_argument { TooManyRecordsException() : std::invalid_argument("indirect sort indexes the records with 32 bits"){} };
+
+// A record's key and the record's index in the unsorted records
+template <typename Key>
+struct KeyIndex
+{
+	Key key;
+	std::uint32_t index;
+};
+
+// Orders the pairs by compare on their keys, the pair of the lower index first among equal keys
+template <typename Compare>
+struct KeyIndexOrder
+{
+	template <typename Key>
+	bool operator()(const KeyIndex<Key>& lhs, const KeyIndex<Key>& rhs) const
+	{
+		if (compare(lhs.key, rhs.key))
+			return true;
+		if (compare(rhs.key, lhs.key))
+			return false;
+
+		return lhs.index < rhs.index;
+	}
+
+	Compare compare;
+};
+
+/* Returns the order of the records sorted ascending by compare on their projections:
+ * the i-th lowest record is records[permutation[i]]. The records are not moved.
+ */
+template <typename T, typename Compare = Less, typename Projection = Identity>
+std::vector<std::uint32_t> sort_permutation(std::size_t numberOfSons, const std::vector<T>& records,
+											const Compare& compare = Compare(), const Projection& projection = Projection())
+{
+	typedef typename std::decay<decltype(projection(records[0]))>::type Key;
+
+	if (records.size() > std::numeric_limits<std::uint32_t>::max())
+		throw TooManyRecordsException();
+
+	std::vector<KeyIndex<Key>> keys;
+	keys.reserve(records.size());
+	for (std::size_t i = 0; i < records.size(); ++i)
+		keys.push_back(KeyIndex<Key>{projection(records[i]), static_cast<std::uint32_t>(i)});
+
+	heap_sort(numberOfSons, keys, KeyIndexOrder<Compare>{compare});
+
+	std::vector<std::uint32_t> permutation;
+	permutation.reserve(keys.size());
+	for (const auto& key : keys)
+		permutation.push_back(key.index);
+
+	return permutation;
+}
+
+/* Moves records[permutation[i]] to records[i] for every i, following the cycles of the permutation.
+ * The permutation is used to mark the records already in place, it is left as the identity.
+ */
+template <typename T>
+void apply_permutation(std::vector<T>& records, std::vector<std::uint32_t>& permutation)
+{
+	for (std::size_t start = 0; start < permutation.size(); ++start)
+	{
+		if (permutation[start] == start)
+			continue;
+
+		// The hole moves along the cycle, each record fills the hole its index names
+		T displaced = std::move(records[start]);
+		auto hole = start;
+		while (permutation[hole] != start)
+		{
+			auto next = permutation[hole];
+			records[hole] = std::move(records[next]);
+			permutation[hole] = hole;
+			hole = next;
+		}
+
+		records[hole] = std::move(displaced);
+		permutation[hole] = hole;
+	}
+}
+
+// Returns the records in the order of the permutation, the records are moved from
+template <typename T>
+std::vector<T> gather_permutation(std::vector<T>& records, const std::vector<std::uint32_t>& permutation)
+{
+	std::vector<T> gathered;
+	gathered.reserve(permutation.size());
+	for (auto index : permutation)
+		gathered.push_back(std::move(records[index]));
+
+	return gathered;
+}
+
+/* Sorts the records in ascending order by compare on their projections, like heap_sort does,
+ * but heap sorts (key, index) pairs and moves every record only once.
+ * Pays off when the records are much larger than their keys, see "dheap indirect".
+ */
+template <typename T, typename Compare = Less, typename Projection = Identity>
+void indirect_heap_sort(std::size_t numberOfSons, std::vector<T>& records,
+						const Compare& compare = Compare(), const Projection& projection = Projection(),
+						PermutationStrategy strategy = CYCLE_PERMUTATION)
+{
+	auto permutation = sort_permutation(numberOfSons, records, compare, projection);
+
+	if (strategy == GATHER_PERMUTATION)
+	{
+		auto gathered = gather_permutation(records, permutation);
+		records.swap(gathered);
+	}
+	else
+		apply_permutation(records, permutation);
+}
+
+}
+
+#endif /* INDIRECT_SORT_H_ */
@@ -0,0 +1,248 @@
+/*
+ * inline_storage.h
+ *
+ *  A fixed-capacity DHeap storage kept inside the heap object, creating and destroying the heap allocates nothing.
+ *
+ *  The policy decides what a push into a full heap of N elements does:
+ *  THROW_WHEN_FULL       - throws HeapIsFullException, like a heap over ArrayData.
+ *  DROP_LOWEST_WHEN_FULL - keeps the N highest elements, the lowest of the N + 1 is dropped (a bounded top-N).
+ *  SPILL_WHEN_FULL       - moves the elements into a std::vector and goes on from there, for the rare large heap.
+ *
+ *  Usage: DHeap<Request, InlineStorage<Request, 64, DROP_LOWEST_WHEN_FULL>> heap(4);
+ */
+
+#ifndef INLINE_STORAGE_H_
+#define INLINE_STORAGE_H_
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "heap_storage.h"
+
+namespace AlgorithmsMaman14{
+
+enum InlineFullPolicy
+{
+	THROW_WHEN_FULL,
+	DROP_LOWEST_WHEN_FULL,
+	SPILL_WHEN_FULL
+};
+
+/* Up to N elements in an aligned buffer inside the object, the elements [0, size()) are constructed.
+ * A storage that spilled keeps its elements in a std::vector from then on.
+ */
+template <typename T, std::size_t N, InlineFullPolicy Policy = THROW_WHEN_FULL>
+class InlineStorage
+{
+	static_assert(N > 0, "an inline storage has room for at least one element");
+
+public:
+	InlineStorage()
+	: elements(inlineElements())
+	, inlineSize(0)
+	{
+	}
+
+	InlineStorage(const InlineStorage& other)
+	: elements(inlineElements())
+	, inlineSize(0)
+	, spilled(other.spilled)
+	{
+		if (other.isSpilled())
+			elements = spilled.data();
+		for (; inlineSize < other.inlineSize; ++inlineSize)
+			new (&elements[inlineSize]) T(other.elements[inlineSize]);
+	}
+
+	InlineStorage(InlineStorage&& other)
+	: elements(inlineElements())
+	, inlineSize(0)
+	{
+		if (other.isSpilled())
+		{
+			spilled.swap(other.spilled);
+			elements = spilled.data();
+			other.elements = other.inlineElements();
+		}
+
+		for (; inlineSize < other.inlineSize; ++inlineSize)
+			new (&elements[inlineSize]) T(std::move(other.elements[inlineSize]));
+	}
+
+	InlineStorage& operator=(const InlineStorage&) = delete;
+
+	~InlineStorage()
+	{
+		while (inlineSize > 0)
+			elements[--inlineSize].~T();
+	}
+
+	const T& operator[] (std::size_t index) const
+	{
+		return elements[index];
+	}
+
+	T& operator[] (std::size_t index)
+	{
+		return elements[index];
+	}
+
+	std::size_t size() const
+	{
+		return isSpilled() ? spilled.size() : inlineSize;
+	}
+
+	bool isFull() const
+	{
+		return !isSpilled() && inlineSize == N;
+	}
+
+	bool isSpilled() const
+	{
+		return elements != inlineElements();
+	}
+
+	template <typename... Args>
+	void emplace_back(Args&&... args)
+	{
+		if (isSpilled())
+		{
+			spilled.emplace_back(std::forward<Args>(args)...);
+			elements = spilled.data();
+			return;
+		}
+
+		if (inlineSize == N)
+		{
+			if (Policy != SPILL_WHEN_FULL)
+				throw HeapIsFullException();
+
+			return spill(std::forward<Args>(args)...);
+		}
+
+		new (&elements[inlineSize]) T(std::forward<Args>(args)...);
+		++inlineSize;
+	}
+
+	void pop_back()
+	{
+		if (isSpilled())
+			spilled.pop_back();
+		else
+			elements[--inlineSize].~T();
+	}
+
+private:
+	T* inlineElements()
+	{
+		return reinterpret_cast<T*>(buffer);
+	}
+
+	const T* inlineElements() const
+	{
+		return reinterpret_cast<const T*>(buffer);
+	}
+
+	// Moves the inline elements and the new element into the vector, the inline buffer is left empty
+	template <typename... Args>
+	void spill(Args&&... args)
+	{
+		// args may refer to one of the inline elements, which are moved from below
+		T element(std::forward<Args>(args)...);
+
+		spilled.reserve(2 * N);
+		for (std::size_t i = 0; i < inlineSize; ++i)
+			spilled.push_back(std::move(elements[i]));
+		spilled.push_back(std::move(element));
+
+		while (inlineSize > 0)
+			elements[--inlineSize].~T();
+		elements = spilled.data();
+	}
+
+	typename std::aligned_storage<sizeof(T), alignof(T)>::type buffer[N];
+	// Points to the inline buffer, or to the vector's elements once the storage spilled
+	T* elements;
+	// Number of constructed elements in the inline buffer, 0 once the storage spilled
+	std::size_t inlineSize;
+	std::vector<T> spilled;
+};
+
+template <typename T, std::size_t N>
+struct DropsLowestWhenFull<InlineStorage<T, N, DROP_LOWEST_WHEN_FULL>> : public std::true_type {};
+
+template <typename T, std::size_t N, InlineFullPolicy Policy>
+struct IsContiguousStorage<InlineStorage<T, N, Policy>> : public std::true_type {};
+
+/*
+ * Template specialization of DHeapData for heaps kept in an InlineStorage.
+ * Like the std::vector storage, the elements past the heap (e.g. the sorted part left by sort())
+ * are kept alive and reused by the next pushes.
+ */
+template <typename T, std::size_t N, InlineFullPolicy Policy>
+class DHeapData<T, InlineStorage<T, N, Policy>>
+{
+public:
+	DHeapData()
+	: heapSize(0)
+	{
+	}
+
+	template <typename InputIterator>
+	DHeapData(InputIterator first, InputIterator last)
+	: heapSize(0)
+	{
+		for (; first != last; ++first, ++heapSize)
+			data.emplace_back(*first);
+	}
+
+	const T* operator[] (std::size_t location) const
+	{
+		return &data[location];
+	}
+
+	T* operator[] (std::size_t location)
+	{
+		return &data[location];
+	}
+
+	size_t length() const
+	{
+		return heapSize;
+	}
+
+	// Whether the next push has to make room, only with DROP_LOWEST_WHEN_FULL (the other policies are handled by the storage)
+	bool isFull() const
+	{
+		return heapSize == data.size() && data.isFull();
+	}
+
+	// Adds a new element right after the last element of the heap
+	template <typename... Args>
+	void emplace(Args&&... args)
+	{
+		if (heapSize < data.size())
+			data[heapSize] = T(std::forward<Args>(args)...);
+		else
+			data.emplace_back(std::forward<Args>(args)...);
+
+		++heapSize;
+	}
+
+	// Removes the last element of the heap
+	void pop()
+	{
+		--heapSize;
+		if (heapSize + 1 == data.size())
+			data.pop_back();
+	}
+
+	InlineStorage<T, N, Policy> data;
+	std::size_t heapSize;
+};
+
+}
+
+#endif /* INLINE_STORAGE_H_ */
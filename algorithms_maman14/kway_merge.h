@@ -0,0 +1,303 @@
+/*
+ * kway_merge.h
+ *
+ *  Merges any number of sorted runs into a single sorted sequence.
+ *
+ *  Every run is given as a pair of input iterators, the merge keeps a cursor per run
+ *  and selects the next element with an engine:
+ *  HeapMergeEngine - the cursors are kept in a d-ary DHeap keyed by their heads (the default).
+ *  LoserTreeMerge  - a tournament tree of losers, a replay costs exactly log2(k) comparisons.
+ *
+ *  Usage: kway_merge(runs.begin(), runs.end(), std::back_inserter(output));
+ *     or: for (auto& element : make_merge_range(runs.begin(), runs.end())) ...
+ */
+
+#ifndef KWAY_MERGE_H_
+#define KWAY_MERGE_H_
+#include <iterator>
+#include <utility>
+#include <vector>
+
+#include "heap.h"
+
+namespace AlgorithmsMaman14{
+
+// Default number of sons of the heap used by HeapMergeEngine
+const std::size_t KWAY_MERGE_SONS = 4;
+
+// The part of a run that was not merged yet
+template <typename Iterator>
+struct MergeCursor
+{
+	bool isExhausted() const
+	{
+		return current == end;
+	}
+
+	Iterator current;
+	Iterator end;
+};
+
+// Collects the runs [firstRun, lastRun) (pairs of iterators) into cursors, leaving out the empty runs
+template <typename Iterator, typename RunIterator>
+std::vector<MergeCursor<Iterator>> mergeCursorsOf(RunIterator firstRun, RunIterator lastRun)
+{
+	std::vector<MergeCursor<Iterator>> cursors;
+	for (; firstRun != lastRun; ++firstRun)
+		if (firstRun->first != firstRun->second)
+			cursors.push_back(MergeCursor<Iterator>{firstRun->first, firstRun->second});
+
+	return cursors;
+}
+
+/* Keeps the cursors in a DHeap whose root is the cursor with the first head.
+ * Advancing takes a single sift: the root's cursor is replaced by its advanced copy.
+ */
+template <typename Iterator, typename Compare>
+class HeapMergeEngine
+{
+public:
+	typedef MergeCursor<Iterator> Cursor;
+	typedef typename std::iterator_traits<Iterator>::reference Reference;
+
+	HeapMergeEngine(std::vector<Cursor> cursors, const Compare& compare, std::size_t numberOfSons)
+	: heap(numberOfSons, orderBy(HeadOrder{compare}), std::move(cursors))
+	{
+	}
+
+	bool empty() const
+	{
+		return heap.isEmpty();
+	}
+
+	Reference front() const
+	{
+		return *heap.root().current;
+	}
+
+	void advance()
+	{
+		Cursor next = heap.root();
+		++next.current;
+
+		if (next.isExhausted())
+			heap.pop();
+		else
+			heap.replace_top(std::move(next));
+	}
+
+private:
+	// A cursor has a lower priority than the other cursor when the other's head comes first
+	struct HeadOrder
+	{
+		bool operator()(const Cursor& lhs, const Cursor& rhs) const
+		{
+			return compare(*rhs.current, *lhs.current);
+		}
+
+		Compare compare;
+	};
+
+	DHeap<Cursor, std::vector<Cursor>, RUNTIME_ARITY, HeadOrder> heap;
+};
+
+/* A tournament tree of losers over the cursors.
+ * The cursors are the leaves k .. 2k - 1 of a binary tree, every inner node keeps the loser of its match
+ * and the overall winner is kept aside. Advancing the winner replays only its path to the root.
+ * Exhausted cursors lose every match, so they never have to be removed.
+ */
+template <typename Iterator, typename Compare>
+class LoserTreeMerge
+{
+public:
+	typedef MergeCursor<Iterator> Cursor;
+	typedef typename std::iterator_traits<Iterator>::reference Reference;
+
+	LoserTreeMerge(std::vector<Cursor> cursors_, const Compare& compare_, std::size_t)
+	: cursors(std::move(cursors_))
+	, compare(compare_)
+	, losers(cursors.size())
+	, winner(0)
+	{
+		auto leaves = cursors.size();
+		if (leaves < 2)
+			return;
+
+		std::vector<std::size_t> winners(2 * leaves);
+		for (std::size_t i = 0; i < leaves; ++i)
+			winners[leaves + i] = i;
+
+		for (auto node = leaves - 1; node > 0; --node)
+		{
+			auto left = winners[2 * node], right = winners[2 * node + 1];
+			if (beats(right, left))
+				std::swap(left, right);
+
+			winners[node] = left;
+			losers[node] = right;
+		}
+
+		winner = winners[1];
+	}
+
+	bool empty() const
+	{
+		return cursors.empty() || cursors[winner].isExhausted();
+	}
+
+	Reference front() const
+	{
+		return *cursors[winner].current;
+	}
+
+	void advance()
+	{
+		++cursors[winner].current;
+
+		auto candidate = winner;
+		for (auto node = (candidate + cursors.size()) / 2; node > 0; node /= 2)
+			if (beats(losers[node], candidate))
+				std::swap(losers[node], candidate);
+
+		winner = candidate;
+	}
+
+private:
+	// Whether the head of cursor first comes before the head of cursor second
+	bool beats(std::size_t first, std::size_t second) const
+	{
+		if (cursors[first].isExhausted())
+			return false;
+		if (cursors[second].isExhausted())
+			return true;
+
+		return compare(*cursors[first].current, *cursors[second].current);
+	}
+
+	std::vector<Cursor> cursors;
+	Compare compare;
+	std::vector<std::size_t> losers;
+	std::size_t winner;
+};
+
+/* A lazy merge of the runs, exposed as an input range.
+ * The runs are read as the range is iterated, so the range has to outlive its iterators.
+ */
+template <typename Iterator, typename Compare = Less, template <typename, typename> class Engine = HeapMergeEngine>
+class MergeRange
+{
+public:
+	typedef typename std::iterator_traits<Iterator>::value_type ValueType;
+	typedef typename std::iterator_traits<Iterator>::reference Reference;
+
+	template <typename RunIterator>
+	MergeRange(RunIterator firstRun, RunIterator lastRun, const Compare& compare = Compare(), std::size_t numberOfSons = KWAY_MERGE_SONS)
+	: engine(mergeCursorsOf<Iterator>(firstRun, lastRun), compare, numberOfSons)
+	{
+	}
+
+	bool empty() const
+	{
+		return engine.empty();
+	}
+
+	Reference front() const
+	{
+		return engine.front();
+	}
+
+	void pop_front()
+	{
+		engine.advance();
+	}
+
+	class iterator
+	{
+	public:
+		typedef std::input_iterator_tag iterator_category;
+		typedef ValueType value_type;
+		typedef std::ptrdiff_t difference_type;
+		typedef const ValueType* pointer;
+		typedef Reference reference;
+
+		explicit iterator(MergeRange* range_ = nullptr)
+		: range(range_)
+		{
+		}
+
+		Reference operator*() const
+		{
+			return range->front();
+		}
+
+		iterator& operator++()
+		{
+			range->pop_front();
+			return *this;
+		}
+
+		void operator++(int)
+		{
+			range->pop_front();
+		}
+
+		// Iterators are equal when both are past the end of the merge
+		bool operator==(const iterator& other) const
+		{
+			return isEnd() == other.isEnd();
+		}
+
+		bool operator!=(const iterator& other) const
+		{
+			return !(*this == other);
+		}
+
+	private:
+		bool isEnd() const
+		{
+			return range == nullptr || range->empty();
+		}
+
+		MergeRange* range;
+	};
+
+	iterator begin()
+	{
+		return iterator(this);
+	}
+
+	iterator end()
+	{
+		return iterator();
+	}
+
+private:
+	Engine<Iterator, Compare> engine;
+};
+
+template <template <typename, typename> class Engine = HeapMergeEngine, typename RunIterator, typename Compare = Less>
+MergeRange<typename std::iterator_traits<RunIterator>::value_type::first_type, Compare, Engine>
+make_merge_range(RunIterator firstRun, RunIterator lastRun, const Compare& compare = Compare(), std::size_t numberOfSons = KWAY_MERGE_SONS)
+{
+	return MergeRange<typename std::iterator_traits<RunIterator>::value_type::first_type, Compare, Engine>(firstRun, lastRun, compare, numberOfSons);
+}
+
+/* Merges the sorted runs [firstRun, lastRun), each a pair of input iterators, into out.
+ * The runs have to be sorted in ascending order by compare, returns the end of the output.
+ */
+template <template <typename, typename> class Engine = HeapMergeEngine, typename RunIterator, typename OutputIterator, typename Compare = Less>
+OutputIterator kway_merge(RunIterator firstRun, RunIterator lastRun, OutputIterator out,
+						  const Compare& compare = Compare(), std::size_t numberOfSons = KWAY_MERGE_SONS)
+{
+	typedef typename std::iterator_traits<RunIterator>::value_type::first_type Iterator;
+
+	Engine<Iterator, Compare> engine(mergeCursorsOf<Iterator>(firstRun, lastRun), compare, numberOfSons);
+	for (; !engine.empty(); engine.advance())
+		*out++ = engine.front();
+
+	return out;
+}
+
+}
+
+#endif /* KWAY_MERGE_H_ */
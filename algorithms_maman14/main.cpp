@@ -15,9 +15,29 @@
 #include <random>
 #include <unordered_map>
 #include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <limits>
 #include <sstream>
+#include <string>
 
+#include "benchmark_suite.h"
+#include "concurrent_benchmark.h"
 #include "heap.h"
+#include "external_sort.h"
+#include "indexed_heap.h"
+#include "indirect_sort.h"
+#include "inline_storage.h"
+#include "mapped_storage.h"
+#include "parallel_sort.h"
+#include "perf_counters.h"
+#include "prefetch_selection.h"
+#include "radix_heap.h"
+#include "simd_selection.h"
+#include "timer_queue.h"
+#include "top_k.h"
 
 using namespace std::chrono;
 using std::endl;
@@ -29,15 +49,27 @@ using namespace AlgorithmsMaman14;
 const int DHEAP_MAX = 5;
 const int DHEAP_MIN = 2;
 
+// Counts the branch misses of the tracked sorts, may not be available (see perf_counters.h)
+HardwareCounter& sortBranchMisses()
+{
+	static HardwareCounter counter(BRANCH_MISSES);
+	return counter;
+}
+
 // Helper method for printing the statistics
 template <typename Counters>
 ostream& printCounters(ostream& out, int d, int numberOfRuns)
 {
-	return out << "compare, emplace, copy = "
-			   << Counters::getOverallCounters(d).compareCounter / numberOfRuns << ", "
-			   << Counters::getOverallCounters(d).emplaceCounter / numberOfRuns << ", "
-			   << Counters::getOverallCounters(d).copyCounter / numberOfRuns << " - "
-			   << "took " << (Counters::getOverallCounters(d).timeToSort.count() / numberOfRuns ) << "us";
+	out << "compare, move, copy = "
+		<< Counters::getOverallCounters(d).compareCounter / numberOfRuns << ", "
+		<< Counters::getOverallCounters(d).moveCounter / numberOfRuns << ", "
+		<< Counters::getOverallCounters(d).copyCounter / numberOfRuns << ", branch misses = ";
+	if (sortBranchMisses().isAvailable())
+		out << Counters::getOverallCounters(d).branchMisses / numberOfRuns;
+	else
+		out << "n/a";
+
+	return out << " - took " << (Counters::getOverallCounters(d).timeToSort.count() / numberOfRuns ) << "us";
 }
 
 // Helper class for measuring statistics
@@ -60,13 +92,14 @@ public:
 	}
 
 	// Used to combine data collected after a single event into the total
-	void addStaticCounters(int index, microseconds timeToSort)
+	void addStaticCounters(int index, microseconds timeToSort, std::uint64_t branchMisses)
 	{
 		auto& counters = getStaticCounters();
 		auto& overall = getOverallCounters(index);
 		overall.compareCounter += counters.compareCounter;
-		overall.emplaceCounter += counters.emplaceCounter;
+		overall.moveCounter += counters.moveCounter;
 		overall.copyCounter += counters.copyCounter;
+		overall.branchMisses += branchMisses;
 		overall.timeToSort += timeToSort;
 
 		counters.reset();
@@ -80,8 +113,9 @@ public:
 	}
 
 	int compareCounter = 0;
-	int emplaceCounter = 0;
+	int moveCounter = 0;
 	int copyCounter = 0;
+	std::uint64_t branchMisses = 0;
 	std::chrono::microseconds timeToSort;
 };
 
@@ -103,16 +137,23 @@ struct CountInteger
 	CountInteger(CountInteger&& other)
 	: real(std::move(other.real))
 	{
-		Counters::getStaticCounters().emplaceCounter++;
+		Counters::getStaticCounters().moveCounter++;
 	}
 
 	CountInteger& operator=(CountInteger&& other)
 	{
-		Counters::getStaticCounters().emplaceCounter++;
+		Counters::getStaticCounters().moveCounter++;
 		real = std::move(other.real);
 		return *this;
 	}
 
+	CountInteger& operator=(const CountInteger& other)
+	{
+		Counters::getStaticCounters().copyCounter++;
+		real = other.real;
+		return *this;
+	}
+
 	operator const Comperable&() const { return real; }
 
 	bool operator>(const CountInteger& other) const
@@ -157,30 +198,32 @@ void assertSorted(std::size_t originalSize, const Heap& heap, std::size_t length
 }
 
 template <typename T>
-microseconds timedSort(int heapSons, T& toSort)
+microseconds timedSort(int heapSons, T& toSort, SortStrategy strategy)
 {
 	auto start = steady_clock::now();
-	heap_sort(heapSons, toSort);
+	heap_sort(heapSons, toSort, strategy);
 	auto end = steady_clock::now();
 
 	return duration_cast<microseconds> (end - start);
 }
 
 template <typename T>
-void trackSortWith(std::size_t d, T& toSort)
+void trackSortWith(std::size_t d, T& toSort, SortStrategy strategy)
 {
 	Counters().getStaticCounters().reset();
-	auto timeToSort = timedSort(d, toSort);
-	Counters().addStaticCounters(d, timeToSort);
+	sortBranchMisses().start();
+	auto timeToSort = timedSort(d, toSort, strategy);
+	sortBranchMisses().stop();
+	Counters().addStaticCounters(d, timeToSort, sortBranchMisses().count());
 }
 
 template <typename T>
-void sortWithDifferentDHeaps(const T& original)
+void sortWithDifferentDHeaps(const T& original, SortStrategy strategy)
 {
 	for (int d = DHEAP_MIN; d <= DHEAP_MAX; ++d)
 	{
 		auto toSort = original; // copying the original string, to work with same input every time.
-		trackSortWith(d, toSort); // sorting with a specific DHeap while tracking the number of compares, copies and emplacements.
+		trackSortWith(d, toSort, strategy); // sorting with a specific DHeap while tracking the number of compares, copies and emplacements.
 		assertSorted(original.size(), toSort, toSort.size()); // making sure the array is indeed sorted.
 	}
 }
@@ -195,51 +238,898 @@ int randomize()
 	return distribution(generator);
 }
 
-void sortNElements(int arraySizeToSort)
+void sortNElements(int arraySizeToSort, SortStrategy strategy)
 {
 	std::vector<CountInteger<int> > original;
 
 	for (int i = 0; i < arraySizeToSort; ++i)
 		original.emplace_back(randomize());
 
-	sortWithDifferentDHeaps(original);
+	sortWithDifferentDHeaps(original, strategy);
+}
+
+const char* strategyName(SortStrategy strategy)
+{
+	return strategy == BOTTOM_UP_SORT ? "bottom-up" : "top-down";
 }
 
-void printSortStatistics(int arraySizeToSort, int d, int reps)
+void printSortStatistics(int arraySizeToSort, int d, int reps, SortStrategy strategy)
 {
-	cout << "Sorting " << arraySizeToSort << " elements with d = " << d << " ";
+	cout << "Sorting " << arraySizeToSort << " elements with d = " << d << " (" << strategyName(strategy) << ") ";
 	printCounters<Counters>(cout, d, reps) << endl;
 }
 
-void collectStatistics(int arraySizeToSort, int reps)
+void collectStatistics(int arraySizeToSort, int reps, SortStrategy strategy)
 {
 	for (int d = DHEAP_MIN; d <= DHEAP_MAX; ++d)
 	{
-		printSortStatistics(arraySizeToSort, d, reps);
+		printSortStatistics(arraySizeToSort, d, reps, strategy);
 		Counters::getOverallCounters(d).reset();
 	}
 }
 
-void repeatSorting(int arraySizeToSort, int reps)
+void repeatSorting(int arraySizeToSort, int reps, SortStrategy strategy)
 {
 	for (int i = 0; i < reps; ++i)
-		sortNElements(arraySizeToSort);
+		sortNElements(arraySizeToSort, strategy);
 }
 
-void measureDHeapSorts(int arraySizeToSort)
+void measureDHeapSorts(int arraySizeToSort, SortStrategy strategy)
 {
 	int reps = 100;
-	repeatSorting(arraySizeToSort, 100);
-	collectStatistics(arraySizeToSort, reps);
+	repeatSorting(arraySizeToSort, reps, strategy);
+	collectStatistics(arraySizeToSort, reps, strategy);
+}
+
+// Measures both sort strategies on the same array size, one after the other
+void measureDHeapSorts(int arraySizeToSort)
+{
+	measureDHeapSorts(arraySizeToSort, TOP_DOWN_SORT);
+	measureDHeapSorts(arraySizeToSort, BOTTOM_UP_SORT);
+}
+
+// Times a priority queue workload, replacing the root with random keys, returns nanoseconds per operation
+template <typename Heap>
+double timeReplaceTop(Heap& heap, const std::vector<int>& keys)
+{
+	auto start = steady_clock::now();
+	for (auto key : keys)
+		heap.replace_top(key);
+	auto end = steady_clock::now();
+
+	return duration_cast<nanoseconds>(end - start).count() / double(keys.size());
+}
+
+// Compares the plain layout with the cache line aligned sons layout on heaps of the given size
+template <std::size_t Sons>
+void compareLayouts(std::size_t size, std::size_t operations)
+{
+	std::mt19937 generator(size);
+	std::vector<int> keys(size);
+	for (auto& key : keys)
+		key = generator();
+
+	std::vector<int> replacements(operations);
+	for (auto& key : replacements)
+		key = generator();
+
+	double plainTime, alignedTime;
+	{
+		DHeap<int, std::vector<int>, Sons> plain(Sons, std::vector<int>(keys));
+		plainTime = timeReplaceTop(plain, replacements);
+	}
+	{
+		DHeap<int, SiblingAlignedVector<int, Sons>, Sons> aligned(Sons, SiblingAlignedVector<int, Sons>(keys.begin(), keys.end()));
+		alignedTime = timeReplaceTop(aligned, replacements);
+	}
+
+	cout << "replace_top on " << size << " ints with d = " << Sons << ": "
+		 << "plain " << plainTime << "ns, aligned sons " << alignedTime << "ns" << endl;
+}
+
+void benchmarkLayouts(std::size_t maxSize)
+{
+	const std::size_t operations = 1000000;
+	for (std::size_t size = 100000; size <= maxSize; size *= 10)
+	{
+		compareLayouts<8>(size, operations);
+		compareLayouts<16>(size, operations);
+	}
 }
 
-int main()
+// Compares heap_sort with parallel_heap_sort on the same random ints, with d = 4
+void benchmarkParallelSort(std::size_t size, std::size_t maxThreads)
+{
+	std::mt19937 generator(size);
+	std::vector<int> original(size);
+	for (auto& key : original)
+		key = generator();
+
+	auto toSort = original;
+	auto start = steady_clock::now();
+	heap_sort(4, toSort);
+	auto serialTime = duration_cast<milliseconds>(steady_clock::now() - start);
+	cout << "heap_sort of " << size << " ints took " << serialTime.count() << "ms" << endl;
+
+	for (std::size_t threads = 2; threads <= maxThreads; threads *= 2)
+	{
+		toSort = original;
+		start = steady_clock::now();
+		parallel_heap_sort(4, toSort, threads);
+		auto parallelTime = duration_cast<milliseconds>(steady_clock::now() - start);
+		assertSorted(original.size(), toSort, toSort.size());
+
+		cout << "parallel_heap_sort with " << threads << " threads took " << parallelTime.count() << "ms" << endl;
+	}
+}
+
+// Exits when an element of the heap outranks its parent
+template <typename Heap>
+void assertHeapProperty(const char* name, const Heap& heap)
+{
+	for (std::size_t i = 1; i < heap.length(); ++i)
+	{
+		if (heap.outranks(heap.storage()[i], heap.storage()[heap.parentOf(i)]))
+		{
+			cout << name << " broke the heap property at index " << i << endl;
+			exit(-1);
+		}
+	}
+}
+
+/* Compares build_max_heap() with build_max_heap(threads) on the same random ints, with d = 4.
+ * Every subtree is heapified after its own subtrees either way, so both builds must leave the same heap.
+ */
+void benchmarkParallelBuild(std::size_t size, std::size_t maxThreads)
+{
+	typedef DHeap<int, std::vector<int>, 4> IntHeap;
+
+	std::mt19937 generator(size);
+	std::vector<int> original(size);
+	for (auto& key : original)
+		key = generator();
+
+	IntHeap serial(4, ATTACH_HEAP, original);
+	auto start = steady_clock::now();
+	serial.build_max_heap();
+	auto serialTime = duration_cast<milliseconds>(steady_clock::now() - start);
+	assertHeapProperty("build_max_heap()", serial);
+	cout << "build_max_heap() of " << size << " ints took " << serialTime.count() << "ms" << endl;
+
+	for (std::size_t threads = 2; threads <= maxThreads; threads *= 2)
+	{
+		IntHeap parallel(4, ATTACH_HEAP, original);
+		start = steady_clock::now();
+		parallel.build_max_heap(threads);
+		auto parallelTime = duration_cast<milliseconds>(steady_clock::now() - start);
+		assertHeapProperty("build_max_heap(threads)", parallel);
+		if (parallel.storage() != serial.storage())
+		{
+			cout << "build_max_heap(" << threads << ") built a different heap than build_max_heap()" << endl;
+			exit(-1);
+		}
+
+		cout << "build_max_heap(" << threads << ") took " << parallelTime.count() << "ms" << endl;
+	}
+}
+
+// Sorts a file of random 64 bit keys with external_sort and checks that the output is sorted
+void benchmarkExternalSort(std::size_t megabytes, const ExternalSortOptions& options)
+{
+	std::string input = options.tempDirectory + "/dheap_external_input.bin";
+	std::string output = options.tempDirectory + "/dheap_external_output.bin";
+	std::size_t records = (megabytes << 20) / sizeof(std::uint64_t);
+
+	std::mt19937_64 generator(records);
+	{
+		RecordWriter<std::uint64_t> writer(input, 1 << 16);
+		for (std::size_t i = 0; i < records; ++i)
+			writer.write(generator());
+		writer.flush();
+	}
+
+	auto report = external_sort<std::uint64_t>(input, output, options);
+
+	RecordReader<std::uint64_t> reader(output, 1 << 16);
+	std::size_t sorted = 0;
+	for (std::uint64_t previous = 0; !reader.isExhausted(); reader.advance(), ++sorted)
+	{
+		if (reader.head() < previous)
+		{
+			cout << "external_sort output is not sorted at record " << sorted << endl;
+			exit(-1);
+		}
+		previous = reader.head();
+	}
+	if (sorted != records)
+	{
+		cout << "external_sort wrote " << sorted << " records out of " << records << endl;
+		exit(-1);
+	}
+
+	std::remove(input.c_str());
+	std::remove(output.c_str());
+
+	cout << "external_sort of " << megabytes << "MB with a budget of " << (options.memoryBudget >> 20) << "MB and a fan-in of " << options.fanIn << ": "
+		 << report.runs << " runs, " << report.mergePasses << " merge passes, " << report.seconds << "s, "
+		 << report.megabytesPerSecond() << "MB/s" << endl;
+}
+
+// Compares selecting the k largest of random ints by top_k with heap sorting all of them
+void benchmarkTopK(std::size_t size, std::size_t k)
+{
+	std::mt19937 generator(size);
+	std::vector<int> original(size);
+	for (auto& key : original)
+		key = generator();
+
+	auto start = steady_clock::now();
+	auto largest = top_k(original.begin(), original.end(), k);
+	auto selectionTime = duration_cast<milliseconds>(steady_clock::now() - start);
+
+	auto toSort = original;
+	start = steady_clock::now();
+	heap_sort(4, toSort);
+	auto sortTime = duration_cast<milliseconds>(steady_clock::now() - start);
+
+	if (!std::equal(largest.begin(), largest.end(), toSort.rbegin()))
+	{
+		cout << "top_k does not match the end of the sorted array" << endl;
+		exit(-1);
+	}
+
+	cout << "top_k of " << k << " out of " << size << " ints took " << selectionTime.count() << "ms, "
+		 << "heap_sort took " << sortTime.count() << "ms" << endl;
+}
+
+// Compares pushing batches of random ints one by one with push_range, into heaps of size ints with d = 4
+void benchmarkBulkInsertion(std::size_t size, std::size_t maxBatch)
+{
+	std::mt19937 generator(size);
+	std::vector<int> original(size);
+	for (auto& key : original)
+		key = generator();
+
+	for (std::size_t batchSize = 1000; batchSize <= maxBatch; batchSize *= 10)
+	{
+		std::vector<int> batch(batchSize);
+		for (auto& key : batch)
+			key = generator();
+
+		DHeap<int> pushed(4, original), bulk(4, original);
+
+		auto start = steady_clock::now();
+		for (auto key : batch)
+			pushed.push(key);
+		auto pushTime = duration_cast<microseconds>(steady_clock::now() - start);
+
+		start = steady_clock::now();
+		bulk.push_range(batch.begin(), batch.end());
+		auto bulkTime = duration_cast<microseconds>(steady_clock::now() - start);
+
+		bulk.sort();
+		assertSorted(size + batchSize, bulk.storage(), size + batchSize);
+
+		cout << "batch of " << batchSize << " into " << size << " ints: push took " << pushTime.count() << "us, "
+			 << "push_range took " << bulkTime.count() << "us" << endl;
+	}
+}
+
+struct Edge
+{
+	std::uint32_t to;
+	std::uint32_t weight;
+};
+
+typedef vector<vector<Edge>> Graph;
+// Tentative distance to a vertex, ordered by the distance first so that std::greater builds a min heap
+typedef std::pair<std::uint64_t, std::uint32_t> PathEstimate;
+
+const std::uint64_t UNREACHED = std::numeric_limits<std::uint64_t>::max();
+
+// A graph with degree random edges out of every vertex, weighted 1 .. 1000
+Graph randomGraph(std::size_t vertices, std::size_t degree)
+{
+	std::mt19937 generator(vertices);
+	Graph graph(vertices);
+	for (auto& edges : graph)
+		for (std::size_t i = 0; i < degree; ++i)
+			edges.push_back(Edge{static_cast<std::uint32_t>(generator() % vertices), static_cast<std::uint32_t>(generator() % 1000 + 1)});
+
+	return graph;
+}
+
+typedef DHeap<PathEstimate, vector<PathEstimate>, 4, std::greater<PathEstimate>> EstimateHeap;
+
+/* Dijkstra from vertex 0, every improved distance is pushed as a new estimate
+ * and the stale estimates are skipped when they are popped.
+ * estimates is an empty min heap of PathEstimates, e.g. EstimateHeap or RadixHeap.
+ */
+template <typename Heap>
+vector<std::uint64_t> dijkstraDuplicatePush(const Graph& graph, Heap& estimates, std::size_t& maxHeapLength)
+{
+	vector<std::uint64_t> distances(graph.size(), UNREACHED);
+
+	distances[0] = 0;
+	estimates.push(PathEstimate(0, 0));
+	maxHeapLength = 1;
+
+	PathEstimate closest;
+	while (estimates.try_pop(closest))
+	{
+		if (closest.first > distances[closest.second])
+			continue;
+
+		for (const auto& edge : graph[closest.second])
+		{
+			auto distance = closest.first + edge.weight;
+			if (distance < distances[edge.to])
+			{
+				distances[edge.to] = distance;
+				estimates.push(PathEstimate(distance, edge.to));
+			}
+		}
+		maxHeapLength = std::max(maxHeapLength, estimates.length());
+	}
+
+	return distances;
+}
+
+// Dijkstra from vertex 0, every vertex has a single estimate that is updated in place
+vector<std::uint64_t> dijkstraIndexed(const Graph& graph, std::size_t& maxHeapLength)
+{
+	typedef IndexedDHeap<PathEstimate, 4, std::greater<PathEstimate>> Heap;
+	vector<std::uint64_t> distances(graph.size(), UNREACHED);
+	vector<Heap::Handle> handles(graph.size());
+	Heap estimates(4, orderBy(std::greater<PathEstimate>()));
+
+	distances[0] = 0;
+	handles[0] = estimates.push(PathEstimate(0, 0));
+	maxHeapLength = 1;
+
+	PathEstimate closest;
+	while (estimates.try_pop(closest))
+	{
+		for (const auto& edge : graph[closest.second])
+		{
+			auto distance = closest.first + edge.weight;
+			if (distance >= distances[edge.to])
+				continue;
+
+			if (distances[edge.to] == UNREACHED)
+				handles[edge.to] = estimates.push(PathEstimate(distance, edge.to));
+			else
+				estimates.update(handles[edge.to], PathEstimate(distance, edge.to));
+			distances[edge.to] = distance;
+		}
+		maxHeapLength = std::max(maxHeapLength, estimates.length());
+	}
+
+	return distances;
+}
+
+// Compares Dijkstra over IndexedDHeap with Dijkstra that pushes duplicates into a DHeap, both with d = 4
+void benchmarkDijkstra(std::size_t vertices, std::size_t degree)
+{
+	auto graph = randomGraph(vertices, degree);
+	std::size_t duplicateLength, indexedLength;
+
+	auto start = steady_clock::now();
+	EstimateHeap estimates(4, orderBy(std::greater<PathEstimate>()));
+	auto duplicateDistances = dijkstraDuplicatePush(graph, estimates, duplicateLength);
+	auto duplicateTime = duration_cast<milliseconds>(steady_clock::now() - start);
+
+	start = steady_clock::now();
+	auto indexedDistances = dijkstraIndexed(graph, indexedLength);
+	auto indexedTime = duration_cast<milliseconds>(steady_clock::now() - start);
+
+	if (duplicateDistances != indexedDistances)
+	{
+		cout << "The distances found with IndexedDHeap differ from the duplicate pushes" << endl;
+		exit(-1);
+	}
+
+	cout << "Dijkstra on " << vertices << " vertices with " << degree << " edges each: "
+		 << "duplicate push took " << duplicateTime.count() << "ms (heap of up to " << duplicateLength << "), "
+		 << "IndexedDHeap took " << indexedTime.count() << "ms (heap of up to " << indexedLength << ")" << endl;
+}
+
+// Exits when a queue long enough to be compacted holds more dead entries than maxDeadFraction allows
+template <typename Queue>
+void assertDeadRatio(const Queue& queue, double maxDeadFraction)
+{
+	if (queue.numberOfEntries() >= TIMER_QUEUE_MIN_COMPACTION_LENGTH && queue.deadRatio() > maxDeadFraction)
+	{
+		cout << "TimerQueue kept a dead ratio of " << queue.deadRatio() << " over " << maxDeadFraction << endl;
+		exit(-1);
+	}
+}
+
+/* Schedules timers over a simulated clock and cancels cancelPercent of them before they fire,
+ * firing the expired timers every tick. Returns the time it took and reports the dead entries.
+ */
+milliseconds runTimers(std::size_t timers, std::size_t cancelPercent, double maxDeadFraction)
+{
+	typedef TimerQueue<std::size_t, std::uint64_t> Queue;
+	const std::uint64_t TIMEOUT = 10000, TIMERS_PER_TICK = 100, RECENT_TIMERS = 1000;
+
+	std::mt19937 generator(timers);
+	Queue queue(maxDeadFraction);
+	vector<TimerToken> tokens;
+	vector<Queue::TimerType> fired;
+	double maxDeadRatio = 0;
+
+	auto start = steady_clock::now();
+	for (std::uint64_t now = 0; tokens.size() < timers || !queue.isEmpty(); ++now)
+	{
+		for (std::size_t i = 0; i < TIMERS_PER_TICK && tokens.size() < timers; ++i)
+		{
+			tokens.push_back(queue.schedule(now + generator() % TIMEOUT + 1, tokens.size()));
+			// Timers are mostly cancelled soon after they are scheduled, e.g. timeouts of requests that were answered
+			if (generator() % 100 < cancelPercent)
+				queue.cancel(tokens[tokens.size() - 1 - generator() % std::min<std::size_t>(tokens.size(), RECENT_TIMERS)]);
+		}
+
+		assertDeadRatio(queue, maxDeadFraction);
+		maxDeadRatio = std::max(maxDeadRatio, queue.deadRatio());
+		fired.clear();
+		queue.pop_expired(now, std::back_inserter(fired));
+		assertDeadRatio(queue, maxDeadFraction);
+	}
+	auto time = duration_cast<milliseconds>(steady_clock::now() - start);
+
+	cout << "  max dead fraction " << maxDeadFraction << ": took " << time.count() << "ms, "
+		 << queue.numberOfCompactions() << " compactions, dead ratio of up to " << maxDeadRatio << endl;
+	return time;
+}
+
+// Compares TimerQueue with and without compactions
+void benchmarkTimers(std::size_t timers, std::size_t cancelPercent)
+{
+	cout << timers << " timers, " << cancelPercent << "% cancelled:" << endl;
+	runTimers(timers, cancelPercent, TIMER_QUEUE_MAX_DEAD_FRACTION);
+	runTimers(timers, cancelPercent, 1);
+}
+
+/* The hold model of discrete event simulation: every popped event schedules a new event
+ * a random delay later. Returns the sum of the popped times, to compare the heaps' results.
+ */
+template <typename Heap>
+std::uint64_t holdEvents(Heap& events, std::size_t pending, std::size_t operations)
+{
+	std::mt19937_64 generator(pending);
+	for (std::size_t i = 0; i < pending; ++i)
+		events.push(PathEstimate(generator() % 1000000, i));
+
+	std::uint64_t checksum = 0;
+	for (std::size_t i = 0; i < operations; ++i)
+	{
+		auto event = events.pop();
+		checksum += event.first;
+		events.push(PathEstimate(event.first + generator() % 1000000, event.second));
+	}
+
+	return checksum;
+}
+
+// Compares RadixHeap with a DHeap of d = 4 on monotone workloads, the hold model and Dijkstra
+void benchmarkRadixHeap(std::size_t pending, std::size_t operations, std::size_t vertices)
+{
+	EstimateHeap events(4, orderBy(std::greater<PathEstimate>()));
+	auto start = steady_clock::now();
+	auto dheapChecksum = holdEvents(events, pending, operations);
+	auto dheapTime = duration_cast<milliseconds>(steady_clock::now() - start);
+
+	RadixHeap<std::uint64_t, std::uint32_t> radixEvents;
+	start = steady_clock::now();
+	auto radixChecksum = holdEvents(radixEvents, pending, operations);
+	auto radixTime = duration_cast<milliseconds>(steady_clock::now() - start);
+
+	if (dheapChecksum != radixChecksum)
+	{
+		cout << "RadixHeap popped different events than DHeap" << endl;
+		exit(-1);
+	}
+	cout << "Hold model with " << pending << " pending events, " << operations << " operations: "
+		 << "DHeap took " << dheapTime.count() << "ms, RadixHeap took " << radixTime.count() << "ms" << endl;
+
+	auto graph = randomGraph(vertices, 8);
+	std::size_t maxHeapLength;
+
+	EstimateHeap estimates(4, orderBy(std::greater<PathEstimate>()));
+	start = steady_clock::now();
+	auto dheapDistances = dijkstraDuplicatePush(graph, estimates, maxHeapLength);
+	dheapTime = duration_cast<milliseconds>(steady_clock::now() - start);
+
+	RadixHeap<std::uint64_t, std::uint32_t> radixEstimates;
+	start = steady_clock::now();
+	auto radixDistances = dijkstraDuplicatePush(graph, radixEstimates, maxHeapLength);
+	radixTime = duration_cast<milliseconds>(steady_clock::now() - start);
+
+	if (dheapDistances != radixDistances)
+	{
+		cout << "The distances found with RadixHeap differ from DHeap" << endl;
+		exit(-1);
+	}
+	cout << "Dijkstra on " << vertices << " vertices with 8 edges each: "
+		 << "DHeap took " << dheapTime.count() << "ms, RadixHeap took " << radixTime.count() << "ms" << endl;
+}
+
+/* Pushes random 64 bit keys into a heap kept in a mapped file, syncs it, reopens the file
+ * and pops the keys back in order from the attached heap.
+ */
+void benchmarkMappedHeap(std::size_t size, const std::string& path)
+{
+	typedef DHeap<std::uint64_t, MappedFileStorage<std::uint64_t>, 4> MappedHeap;
+	std::remove(path.c_str());
+
+	std::mt19937_64 generator(size);
+	auto start = steady_clock::now();
+	milliseconds syncTime;
+	{
+		MappedHeap heap(4, path);
+		for (std::size_t i = 0; i < size; ++i)
+			heap.push(generator());
+
+		auto syncStart = steady_clock::now();
+		heap.storage().sync();
+		syncTime = duration_cast<milliseconds>(steady_clock::now() - syncStart);
+	}
+	auto pushTime = duration_cast<milliseconds>(steady_clock::now() - start) - syncTime;
+
+	start = steady_clock::now();
+	MappedHeap heap(4, ATTACH_HEAP, path);
+	auto attachTime = duration_cast<microseconds>(steady_clock::now() - start);
+
+	start = steady_clock::now();
+	for (auto previous = heap.root(); !heap.isEmpty(); previous = heap.pop())
+	{
+		if (previous < heap.root())
+		{
+			cout << "The attached heap popped its keys out of order" << endl;
+			exit(-1);
+		}
+	}
+	auto popTime = duration_cast<milliseconds>(steady_clock::now() - start);
+	std::remove(path.c_str());
+
+	cout << size << " keys in a mapped heap: pushes took " << pushTime.count() << "ms, "
+		 << "syncing took " << syncTime.count() << "ms, attaching took " << attachTime.count() << "us, pops took " << popTime.count() << "ms" << endl;
+}
+
+// Creates a heap, pushes size random ints and pops them all, heaps times. Returns the sum of the roots.
+template <typename Heap>
+long long churnSmallHeaps(std::size_t heaps, std::size_t size)
+{
+	std::mt19937 generator(size);
+	long long checksum = 0;
+	for (std::size_t i = 0; i < heaps; ++i)
+	{
+		Heap heap(4);
+		for (std::size_t j = 0; j < size; ++j)
+			heap.push(generator() % 1000);
+		while (!heap.isEmpty())
+			checksum += heap.pop();
+	}
+
+	return checksum;
+}
+
+// Compares short-lived heaps of up to 64 ints over a std::vector with heaps over an InlineStorage
+void benchmarkInlineStorage(std::size_t heaps)
+{
+	for (std::size_t size = 4; size <= 64; size *= 4)
+	{
+		auto start = steady_clock::now();
+		auto vectorChecksum = churnSmallHeaps<DHeap<int, vector<int>, 4>>(heaps, size);
+		auto vectorTime = duration_cast<milliseconds>(steady_clock::now() - start);
+
+		start = steady_clock::now();
+		auto inlineChecksum = churnSmallHeaps<DHeap<int, InlineStorage<int, 64>, 4>>(heaps, size);
+		auto inlineTime = duration_cast<milliseconds>(steady_clock::now() - start);
+
+		if (vectorChecksum != inlineChecksum)
+		{
+			cout << "The inline heaps popped different elements than the vector heaps" << endl;
+			exit(-1);
+		}
+
+		cout << heaps << " heaps of " << size << " ints: std::vector took " << vectorTime.count() << "ms, "
+			 << "InlineStorage took " << inlineTime.count() << "ms" << endl;
+	}
+}
+
+// A record of Bytes bytes, sorted by its first 8 bytes
+template <std::size_t Bytes>
+struct Record
+{
+	std::uint64_t key;
+	char payload[Bytes - sizeof(std::uint64_t)];
+};
+
+struct RecordKey
+{
+	template <std::size_t Bytes>
+	std::uint64_t operator()(const Record<Bytes>& record) const
+	{
+		return record.key;
+	}
+};
+
+// Times heap_sort against both permutation strategies of indirect_heap_sort on records of Bytes bytes, with d = 4
+template <std::size_t Bytes>
+void compareIndirectSort(std::size_t size)
+{
+	std::mt19937_64 generator(size);
+	std::vector<Record<Bytes>> original(size);
+	for (auto& record : original)
+	{
+		record.key = generator();
+		std::fill(std::begin(record.payload), std::end(record.payload), static_cast<char>(record.key));
+	}
+
+	auto direct = original;
+	auto start = steady_clock::now();
+	heap_sort(4, direct, std::less<std::uint64_t>(), RecordKey());
+	auto directTime = duration_cast<milliseconds>(steady_clock::now() - start);
+
+	milliseconds indirectTimes[2];
+	for (auto strategy : {CYCLE_PERMUTATION, GATHER_PERMUTATION})
+	{
+		auto indirect = original;
+		start = steady_clock::now();
+		indirect_heap_sort(4, indirect, std::less<std::uint64_t>(), RecordKey(), strategy);
+		indirectTimes[strategy] = duration_cast<milliseconds>(steady_clock::now() - start);
+
+		for (std::size_t i = 0; i < size; ++i)
+			if (indirect[i].key != direct[i].key || indirect[i].payload[0] != direct[i].payload[0])
+			{
+				cout << "indirect_heap_sort does not match heap_sort on records of " << Bytes << " bytes" << endl;
+				exit(-1);
+			}
+	}
+
+	cout << size << " records of " << Bytes << " bytes: heap_sort took " << directTime.count() << "ms, "
+		 << "indirect_heap_sort took " << indirectTimes[CYCLE_PERMUTATION].count() << "ms (cycles), "
+		 << indirectTimes[GATHER_PERMUTATION].count() << "ms (gather)" << endl;
+}
+
+// Compares heap_sort with indirect_heap_sort on records of 16 to 512 bytes, to find where sorting indirectly pays off
+void benchmarkIndirectSort(std::size_t size)
+{
+	compareIndirectSort<16>(size);
+	compareIndirectSort<32>(size);
+	compareIndirectSort<64>(size);
+	compareIndirectSort<128>(size);
+	compareIndirectSort<256>(size);
+	compareIndirectSort<512>(size);
+}
+
+/* Times replace_top with random keys on the heap in keys, sifting with SonSelection, and prints ns and hardware events per operation.
+ * The heap is reached through a view, so the same keys serve every policy without a copy.
+ */
+template <std::size_t Sons, typename SonSelection>
+void timePrefetching(const char* name, std::vector<int>& keys, const std::vector<int>& replacements)
+{
+	DHeapView<int, Sons, Less, Identity, SonSelection> heap(Sons, ATTACH_HEAP, keys.data(), keys.size(), keys.size());
+
+	HardwareCounter cacheMisses(CACHE_MISSES), stalls(BACKEND_STALL_CYCLES);
+	cacheMisses.start();
+	stalls.start();
+	auto nanoseconds = timeReplaceTop(heap, replacements);
+	stalls.stop();
+	cacheMisses.stop();
+
+	cout << "  " << name << ": " << nanoseconds << "ns, cache misses ";
+	printPerOperation(cout, cacheMisses, replacements.size()) << ", stalled cycles ";
+	printPerOperation(cout, stalls, replacements.size()) << " per operation" << endl;
+}
+
+// Compares sifting without prefetching with PrefetchSelection at distances 1 and 2, on a heap of size random ints
+template <std::size_t Sons>
+void comparePrefetching(std::size_t size, const std::vector<int>& replacements)
+{
+	std::mt19937 generator(size);
+	std::vector<int> keys(size);
+	for (auto& key : keys)
+		key = generator();
+
+	// Heapifying the keys in place, every policy then attaches to them
+	DHeapView<int, Sons> heap(Sons, keys.data(), keys.size());
+
+	cout << "replace_top on " << size << " ints with d = " << Sons << ":" << endl;
+	timePrefetching<Sons, ScanSelection>("no prefetching", keys, replacements);
+	timePrefetching<Sons, PrefetchSelection<1>>("prefetch distance 1", keys, replacements);
+	timePrefetching<Sons, PrefetchSelection<2>>("prefetch distance 2", keys, replacements);
+}
+
+// Measures PrefetchSelection on heaps of 10^7 ints up to maxSize, larger than the last level cache
+void benchmarkPrefetching(std::size_t maxSize)
+{
+	std::mt19937 generator(maxSize);
+	std::vector<int> replacements(1000000);
+	for (auto& key : replacements)
+		key = generator();
+
+	for (std::size_t size = 10000000; size <= maxSize; size *= 10)
+	{
+		comparePrefetching<2>(size, replacements);
+		comparePrefetching<4>(size, replacements);
+		comparePrefetching<8>(size, replacements);
+	}
+}
+
+// Heap sorts a copy of keys with SonSelection, prints the time and the branch misses per element
+template <std::size_t Sons, typename SonSelection, typename Key>
+std::vector<Key> timeSonSelection(const char* name, const std::vector<Key>& keys)
+{
+	auto toSort = keys;
+	HardwareCounter branchMisses(BRANCH_MISSES);
+	branchMisses.start();
+	auto start = steady_clock::now();
+	heap_sort<Sons, SonSelection>(toSort);
+	auto sortTime = duration_cast<milliseconds>(steady_clock::now() - start);
+	branchMisses.stop();
+
+	if (!std::is_sorted(toSort.begin(), toSort.end()))
+	{
+		cout << name << " did not sort the keys" << endl;
+		exit(-1);
+	}
+
+	cout << "  " << name << ": " << sortTime.count() << "ms, branch misses ";
+	printPerOperation(cout, branchMisses, keys.size()) << " per element" << endl;
+	return toSort;
+}
+
+// Like timeSonSelection, and checks the keys come out as the scalar heap_sort sorted them
+template <std::size_t Sons, typename SonSelection, typename Key>
+void timeSonSelection(const char* name, const std::vector<Key>& keys, const std::vector<Key>& scalarSorted)
+{
+	if (timeSonSelection<Sons, SonSelection>(name, keys) != scalarSorted)
+	{
+		cout << name << " sorted the keys differently than ScanSelection" << endl;
+		exit(-1);
+	}
+}
+
+template <std::size_t Sons, typename Key>
+void compareSonSelections(const char* keyName, const std::vector<Key>& keys)
+{
+	cout << "heap_sort of " << keys.size() << " random " << keyName << " with d = " << Sons << ":" << endl;
+	auto scalarSorted = timeSonSelection<Sons, ScanSelection>("ScanSelection", keys);
+	timeSonSelection<Sons, BranchlessSelection>("BranchlessSelection", keys, scalarSorted);
+	timeSonSelection<Sons, SimdSelection>("SimdSelection", keys, scalarSorted);
+}
+
+template <typename Key>
+void compareSonSelections(const char* keyName, const std::vector<Key>& keys)
+{
+	compareSonSelections<2>(keyName, keys);
+	compareSonSelections<4>(keyName, keys);
+	compareSonSelections<8>(keyName, keys);
+	compareSonSelections<16>(keyName, keys);
+}
+
+// A/B test of ScanSelection against BranchlessSelection and SimdSelection on random int, uint64_t, float and double keys
+void benchmarkBranchlessSelection(std::size_t size)
+{
+	std::mt19937_64 generator(size);
+	std::vector<int> ints(size);
+	std::vector<std::uint64_t> longs(size);
+	std::vector<float> floats(size);
+	std::vector<double> doubles(size);
+	for (std::size_t i = 0; i < size; ++i)
+	{
+		longs[i] = generator();
+		ints[i] = static_cast<int>(longs[i]);
+		doubles[i] = static_cast<double>(longs[i] >> 11) / (1ULL << 53);
+		floats[i] = static_cast<float>(doubles[i]);
+	}
+
+	compareSonSelections("ints", ints);
+	compareSonSelections("uint64s", longs);
+	compareSonSelections("floats", floats);
+	compareSonSelections("doubles", doubles);
+}
+
+void measureAllDHeapSorts()
 {
 	measureDHeapSorts(50);
 	cout << endl;
 	measureDHeapSorts(100);
 	cout << endl;
 	measureDHeapSorts(200);
+}
+
+/* Usage: dheap [suite] [options]            - the benchmark suite, see parseBenchmarkSuiteOptions in benchmark_suite.h
+ *                                            (e.g. dheap suite --sizes=6..9 --types=int,struct256 --d=2,4,8 --format=csv)
+ *        dheap stats                       - compare, move and copy counts of sorting small arrays
+ *                                            (and branch misses, where the CPU counts them)
+ *        dheap layout [size]               - plain vs. aligned sons layout, heaps from 10^5 up to size (10^8 by default)
+ *        dheap parallel [size] [threads]   - heap_sort vs. parallel_heap_sort (10^8 ints, up to the number of cores by default)
+ *        dheap build [size] [threads]      - build_max_heap() vs. build_max_heap(threads) (10^8 ints, up to the number of cores by default)
+ *        dheap external [MB] [budget MB] [fan-in] [temp dir]
+ *                                          - external_sort of a file of random 64 bit keys (256MB with a 16MB budget by default)
+ *        dheap topk [size] [k]             - top_k vs. heap_sort (the 1000 largest of 10^8 ints by default)
+ *        dheap bulk [size] [batch]         - push vs. push_range of batches from 1000 up to batch into a heap of size (10^6 both by default)
+ *        dheap multiqueue [threads] [ops]  - ConcurrentDHeap vs. FlatCombiningDHeap vs. a locked DHeap
+ *                                            (up to the number of cores, 10^7 operations by default)
+ *        dheap dijkstra [vertices] [degree] - IndexedDHeap vs. duplicate pushes (10^6 vertices with 8 edges each by default)
+ *        dheap timers [timers] [cancel %]  - TimerQueue with vs. without compactions (10^7 timers, 90% cancelled by default)
+ *        dheap radix [pending] [ops] [vertices]
+ *                                          - RadixHeap vs. DHeap on the hold model and on Dijkstra
+ *                                            (10^6 pending events, 10^7 operations, 10^6 vertices by default)
+ *        dheap mapped [size] [file]        - push, sync, reattach and pop a heap kept in a mapped file (10^7 keys by default)
+ *        dheap inline [heaps]              - short-lived heaps of 4 to 64 ints over std::vector vs. InlineStorage (10^6 heaps by default)
+ *        dheap indirect [size]             - heap_sort vs. indirect_heap_sort on records of 16 to 512 bytes (10^6 records by default)
+ *        dheap prefetch [max size]         - replace_top with and without PrefetchSelection on heaps of 10^7 ints and up (up to 10^8 by default)
+ *        dheap branchless [size]           - heap_sort with ScanSelection vs. BranchlessSelection and SimdSelection on random keys (10^7 keys by default)
+ */
+int main(int argc, char* argv[])
+{
+	std::string benchmark = argc > 1 ? argv[1] : "";
+
+	if (benchmark == "stats")
+		measureAllDHeapSorts();
+	else if (benchmark == "layout")
+		benchmarkLayouts(argc > 2 ? std::stoull(argv[2]) : 100000000);
+	else if (benchmark == "parallel")
+		benchmarkParallelSort(argc > 2 ? std::stoull(argv[2]) : 100000000,
+							  argc > 3 ? std::stoull(argv[3]) : std::thread::hardware_concurrency());
+	else if (benchmark == "build")
+		benchmarkParallelBuild(argc > 2 ? std::stoull(argv[2]) : 100000000,
+							   argc > 3 ? std::stoull(argv[3]) : std::thread::hardware_concurrency());
+	else if (benchmark == "external")
+	{
+		ExternalSortOptions options;
+		options.memoryBudget = (argc > 3 ? std::stoull(argv[3]) : 16) << 20;
+		options.fanIn = argc > 4 ? std::stoull(argv[4]) : options.fanIn;
+		options.tempDirectory = argc > 5 ? argv[5] : options.tempDirectory;
+		benchmarkExternalSort(argc > 2 ? std::stoull(argv[2]) : 256, options);
+	}
+	else if (benchmark == "topk")
+		benchmarkTopK(argc > 2 ? std::stoull(argv[2]) : 100000000,
+					  argc > 3 ? std::stoull(argv[3]) : 1000);
+	else if (benchmark == "bulk")
+		benchmarkBulkInsertion(argc > 2 ? std::stoull(argv[2]) : 1000000,
+							   argc > 3 ? std::stoull(argv[3]) : 1000000);
+	else if (benchmark == "multiqueue")
+		benchmarkMultiQueue(argc > 2 ? std::stoull(argv[2]) : std::thread::hardware_concurrency(),
+							argc > 3 ? std::stoull(argv[3]) : 10000000);
+	else if (benchmark == "dijkstra")
+		benchmarkDijkstra(argc > 2 ? std::stoull(argv[2]) : 1000000,
+						  argc > 3 ? std::stoull(argv[3]) : 8);
+	else if (benchmark == "timers")
+		benchmarkTimers(argc > 2 ? std::stoull(argv[2]) : 10000000,
+						argc > 3 ? std::stoull(argv[3]) : 90);
+	else if (benchmark == "radix")
+		benchmarkRadixHeap(argc > 2 ? std::stoull(argv[2]) : 1000000,
+						   argc > 3 ? std::stoull(argv[3]) : 10000000,
+						   argc > 4 ? std::stoull(argv[4]) : 1000000);
+	else if (benchmark == "mapped")
+		benchmarkMappedHeap(argc > 2 ? std::stoull(argv[2]) : 10000000,
+							argc > 3 ? argv[3] : "dheap_mapped.heap");
+	else if (benchmark == "inline")
+		benchmarkInlineStorage(argc > 2 ? std::stoull(argv[2]) : 1000000);
+	else if (benchmark == "indirect")
+		benchmarkIndirectSort(argc > 2 ? std::stoull(argv[2]) : 1000000);
+	else if (benchmark == "prefetch")
+		benchmarkPrefetching(argc > 2 ? std::stoull(argv[2]) : 100000000);
+	else if (benchmark == "branchless")
+		benchmarkBranchlessSelection(argc > 2 ? std::stoull(argv[2]) : 10000000);
+	else
+	{
+		try
+		{
+			runBenchmarkSuite(parseBenchmarkSuiteOptions(argc, argv, benchmark == "suite" ? 2 : 1));
+		}
+		catch (const InvalidSuiteOptionException& e)
+		{
+			std::cerr << e.what() << endl;
+			return 1;
+		}
+	}
 
 	return 0;
 }
@@ -0,0 +1,310 @@
+/*
+ * mapped_storage.h
+ *
+ *  A DHeap storage kept in a memory-mapped file (POSIX only).
+ *
+ *  The file starts with a page holding a header (the record size and the heap's length), the records follow
+ *  from the second page on. The heap's length lives in the mapped header, so the file always describes the
+ *  heap and reopening it attaches to the heap in O(1): DHeap<Record, MappedFileStorage<Record>> heap(d, ATTACH_HEAP, path);
+ *  The file grows with ftruncate and the records are remapped, references to elements do not survive a push.
+ *
+ *  Usage: DHeap<Record, MappedFileStorage<Record>> heap(4, "queue.heap"); ... heap.push(record);
+ *         heap.storage().sync(); // the pushes are on disk
+ */
+
+#ifndef MAPPED_STORAGE_H_
+#define MAPPED_STORAGE_H_
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+#include "heap_storage.h"
+
+namespace AlgorithmsMaman14{
+
+// Records a new heap file has room for before it first grows
+const std::size_t MAPPED_STORAGE_INITIAL_CAPACITY = 1 << 16;
+// Identifies the heap files, "DHEAPMAP" in ASCII
+const std::uint64_t MAPPED_STORAGE_MAGIC = 0x44484541504d4150ULL;
+
+// Access pattern hints for the mapped records, passed to madvise
+enum MappedAccess
+{
+	NORMAL_ACCESS = MADV_NORMAL,
+	// Building or scanning the heap, read-ahead pays off
+	SEQUENTIAL_ACCESS = MADV_SEQUENTIAL,
+	// Sifting a large heap touches a page or two per level, read-ahead is wasted
+	RANDOM_ACCESS = MADV_RANDOM
+};
+
+struct MappedFileException : public std::runtime_error
+{
+	MappedFileException(const std::string& what, const std::string& path)
+	: std::runtime_error(what + " " + path + ": " + std::strerror(errno))
+	{
+	}
+};
+
+/* Fixed-size records in a memory-mapped file, T has to be trivially copyable.
+ * Opens the file at path, creating it when it does not exist. An existing file has to be a heap file of T.
+ */
+template <typename T>
+class MappedFileStorage
+{
+	static_assert(std::is_trivially_copyable<T>::value, "records are stored in the file in their memory representation");
+
+public:
+	MappedFileStorage(const std::string& path_, std::size_t initialCapacity = MAPPED_STORAGE_INITIAL_CAPACITY)
+	: path(path_)
+	, pageSize(sysconf(_SC_PAGESIZE))
+	, file(-1)
+	, header(nullptr)
+	, records(nullptr)
+	, capacity(0)
+	, access(NORMAL_ACCESS)
+	{
+		try
+		{
+			openFile(initialCapacity);
+		}
+		catch (...)
+		{
+			release();
+			throw;
+		}
+	}
+
+	~MappedFileStorage()
+	{
+		release();
+	}
+
+	MappedFileStorage(const MappedFileStorage&) = delete;
+	MappedFileStorage& operator=(const MappedFileStorage&) = delete;
+
+	const T& operator[] (std::size_t index) const
+	{
+		return records[index];
+	}
+
+	T& operator[] (std::size_t index)
+	{
+		return records[index];
+	}
+
+	// Number of records the file has room for
+	std::size_t size() const
+	{
+		return capacity;
+	}
+
+	// Grows the file to room for at least newCapacity records and remaps them
+	void reserve(std::size_t newCapacity)
+	{
+		if (newCapacity <= capacity)
+			return;
+
+		if (ftruncate(file, pageSize + newCapacity * sizeof(T)) != 0)
+			fail("cannot grow");
+
+		munmap(records, capacity * sizeof(T));
+		records = nullptr;
+		mapRecords();
+		advise(access);
+	}
+
+	// The heap's length as recorded in the file's header
+	std::uint64_t& storedLength()
+	{
+		return header->length;
+	}
+
+	void advise(MappedAccess access_)
+	{
+		access = access_;
+		madvise(records, capacity * sizeof(T), access);
+	}
+
+	MappedAccess currentAccess() const
+	{
+		return access;
+	}
+
+	// Writes the records and the header back to the file, returns after the writes are done
+	void sync()
+	{
+		if (msync(records, capacity * sizeof(T), MS_SYNC) != 0 || msync(header, pageSize, MS_SYNC) != 0)
+			fail("cannot sync");
+	}
+
+private:
+	// Fixed-width fields, the header's layout does not depend on the platform that wrote the file
+	struct Header
+	{
+		std::uint64_t magic;
+		std::uint64_t recordSize;
+		std::uint64_t length;
+	};
+
+	void mapRecords()
+	{
+		struct stat status;
+		if (fstat(file, &status) != 0)
+			fail("cannot stat");
+		if (status.st_size < static_cast<off_t>(pageSize))
+			failTooShort();
+
+		capacity = (status.st_size - pageSize) / sizeof(T);
+		void* mapping = mmap(nullptr, capacity * sizeof(T), PROT_READ | PROT_WRITE, MAP_SHARED, file, pageSize);
+		if (mapping == MAP_FAILED)
+			fail("cannot map the records of");
+
+		records = static_cast<T*>(mapping);
+	}
+
+	void openFile(std::size_t initialCapacity)
+	{
+		file = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+		if (file < 0)
+			fail("cannot open");
+
+		struct stat status;
+		if (fstat(file, &status) != 0)
+			fail("cannot stat");
+
+		bool created = status.st_size == 0;
+		if (created && ftruncate(file, pageSize + std::max<std::size_t>(initialCapacity, 1) * sizeof(T)) != 0)
+			fail("cannot grow");
+		// Mapping the header of a shorter file would fault on the first read of it
+		if (!created && status.st_size < static_cast<off_t>(pageSize))
+			failTooShort();
+
+		void* mapping = mmap(nullptr, pageSize, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+		if (mapping == MAP_FAILED)
+			fail("cannot map the header of");
+		header = static_cast<Header*>(mapping);
+
+		if (created)
+			*header = Header{MAPPED_STORAGE_MAGIC, sizeof(T), 0};
+		else if (header->magic != MAPPED_STORAGE_MAGIC || header->recordSize != sizeof(T))
+		{
+			errno = EINVAL;
+			fail("not a heap file of this record type,");
+		}
+
+		mapRecords();
+	}
+
+	void release()
+	{
+		if (records)
+			munmap(records, capacity * sizeof(T));
+		if (header)
+			munmap(header, pageSize);
+		if (file >= 0)
+			::close(file);
+
+		records = nullptr;
+		header = nullptr;
+		file = -1;
+	}
+
+	void fail(const std::string& what) const
+	{
+		throw MappedFileException(what, path);
+	}
+
+	void failTooShort() const
+	{
+		errno = EINVAL;
+		fail("too short to be a heap file,");
+	}
+
+	std::string path;
+	std::size_t pageSize;
+	int file;
+	Header* header;
+	T* records;
+	std::size_t capacity;
+	MappedAccess access;
+};
+
+template <typename T>
+struct IsContiguousStorage<MappedFileStorage<T>> : public std::true_type {};
+
+/*
+ * Template specialization of DHeapData for heaps kept in a MappedFileStorage.
+ * heapSize refers to the length in the file's header, so every push and pop is recorded in the file.
+ * The records are advised for sequential access while the heap is built and for random access
+ * from the first push or pop on.
+ */
+template <typename T>
+class DHeapData<T, MappedFileStorage<T>>
+{
+public:
+	explicit DHeapData(const std::string& path, std::size_t initialCapacity = MAPPED_STORAGE_INITIAL_CAPACITY)
+	: data(path, initialCapacity)
+	, heapSize(data.storedLength())
+	{
+		data.advise(SEQUENTIAL_ACCESS);
+	}
+
+	const T* operator[] (std::size_t location) const
+	{
+		return &data[location];
+	}
+
+	T* operator[] (std::size_t location)
+	{
+		return &data[location];
+	}
+
+	size_t length() const
+	{
+		return heapSize;
+	}
+
+	// Adds a new element right after the last element of the heap, doubling the file when it is full
+	template <typename... Args>
+	void emplace(Args&&... args)
+	{
+		// Built before the file is remapped, args may refer to records of the heap
+		T element(std::forward<Args>(args)...);
+
+		adviseRandomAccess();
+		if (heapSize == data.size())
+			data.reserve(2 * data.size());
+
+		data[heapSize] = std::move(element);
+		++heapSize;
+	}
+
+	// Removes the last element of the heap, the file keeps its size
+	void pop()
+	{
+		adviseRandomAccess();
+		--heapSize;
+	}
+
+	MappedFileStorage<T> data;
+	std::uint64_t& heapSize;
+
+private:
+	void adviseRandomAccess()
+	{
+		if (data.currentAccess() != RANDOM_ACCESS)
+			data.advise(RANDOM_ACCESS);
+	}
+};
+
+}
+
+#endif /* MAPPED_STORAGE_H_ */
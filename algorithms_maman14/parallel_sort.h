@@ -0,0 +1,106 @@
+/*
+ * parallel_sort.h
+ *
+ *  Multi-threaded heap sort.
+ *
+ *  The input is split into one run per thread and every run is heap sorted on its own thread.
+ *  The sorted runs are then cut by common splitters into independent parts of the output,
+ *  and every thread merges its part of all the runs with kway_merge over a d-ary heap.
+ */
+
+#ifndef PARALLEL_SORT_H_
+#define PARALLEL_SORT_H_
+#include <algorithm>
+#include <iterator>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "heap.h"
+#include "kway_merge.h"
+
+namespace AlgorithmsMaman14{
+
+// Inputs shorter than this are sorted on the calling thread by parallel_heap_sort
+const std::size_t PARALLEL_SORT_MIN_LENGTH = 1 << 16;
+
+// Calls task(0) .. task(threads - 1), each on its own thread, task(0) runs on the calling thread.
+template <typename Task>
+void runOnThreads(std::size_t threads, const Task& task)
+{
+	std::vector<std::thread> workers;
+	for (std::size_t i = 1; i < threads; ++i)
+		workers.emplace_back(task, i);
+
+	task(0);
+	for (auto& worker : workers)
+		worker.join();
+}
+
+/* Sorts data in ascending order by compare, using up to threads threads (the calling thread is one of them).
+ * Inputs shorter than PARALLEL_SORT_MIN_LENGTH are sorted serially with heap_sort.
+ * The merge goes through an output buffer of data.size() elements, so T has to be default constructible.
+ */
+template <typename T, typename Compare = Less, typename Projection = Identity>
+void parallel_heap_sort(std::size_t numberOfSons, std::vector<T>& data, std::size_t threads = std::thread::hardware_concurrency(),
+						const Compare& compare = Compare(), const Projection& projection = Projection())
+{
+	if (threads < 2 || data.size() < PARALLEL_SORT_MIN_LENGTH)
+		return heap_sort(numberOfSons, data, compare, projection);
+
+	// Sorting a run per thread
+	std::vector<std::size_t> runBounds;
+	for (std::size_t i = 0; i <= threads; ++i)
+		runBounds.push_back(data.size() * i / threads);
+
+	auto sortRun = [&](std::size_t run)
+	{
+		heap_sort(numberOfSons, ArrayData<T>(data.data() + runBounds[run], runBounds[run + 1] - runBounds[run]), compare, projection);
+	};
+	runOnThreads(threads, sortRun);
+
+	// Sampling the runs evenly, the splitters are then taken evenly from the sorted samples
+	auto keyLess = [&](const T& lhs, const T& rhs) { return compare(projection(lhs), projection(rhs)); };
+	std::vector<T> samples;
+	for (std::size_t run = 0; run < threads; ++run)
+		for (std::size_t i = 1; i <= threads; ++i)
+			samples.push_back(data[runBounds[run] + (runBounds[run + 1] - runBounds[run]) * i / (threads + 1)]);
+	std::sort(samples.begin(), samples.end(), keyLess);
+
+	/* Cutting every run at every splitter, part p of every run holds the elements between splitter p - 1 and splitter p.
+	 * cuts[p][run] is the beginning of part p in the run.
+	 */
+	std::vector<std::vector<T*>> cuts(threads + 1, std::vector<T*>(threads));
+	for (std::size_t run = 0; run < threads; ++run)
+	{
+		T* begin = data.data() + runBounds[run];
+		T* end = data.data() + runBounds[run + 1];
+		cuts[0][run] = begin;
+		cuts[threads][run] = end;
+		for (std::size_t part = 1; part < threads; ++part)
+			cuts[part][run] = std::lower_bound(cuts[part - 1][run], end, samples[part * threads], keyLess);
+	}
+
+	// Every part is merged into its own range of the output
+	std::vector<T> merged(data.size());
+	auto mergePart = [&](std::size_t part)
+	{
+		typedef std::move_iterator<T*> RunIterator;
+		std::vector<std::pair<RunIterator, RunIterator>> runs;
+		std::size_t offset = 0;
+		for (std::size_t run = 0; run < threads; ++run)
+		{
+			runs.emplace_back(RunIterator(cuts[part][run]), RunIterator(cuts[part + 1][run]));
+			offset += cuts[part][run] - (data.data() + runBounds[run]);
+		}
+
+		kway_merge(runs.begin(), runs.end(), merged.data() + offset, keyLess, numberOfSons);
+	};
+	runOnThreads(threads, mergePart);
+
+	data.swap(merged);
+}
+
+}
+
+#endif /* PARALLEL_SORT_H_ */
@@ -0,0 +1,139 @@
+/*
+ * perf_counters.h
+ *
+ *  Hardware event counters for the benchmarks, read through Linux's perf_event_open.
+ *
+ *  Counts the events of the calling thread in user space only, between start() and stop().
+ *  Virtual machines and locked-down kernels (perf_event_paranoid) often expose no hardware events,
+ *  a counter that could not be opened reports isAvailable() == false and the benchmarks print n/a.
+ *
+ *  Usage: HardwareCounter misses(CACHE_MISSES); misses.start(); ... misses.stop(); misses.count();
+ */
+
+#ifndef PERF_COUNTERS_H_
+#define PERF_COUNTERS_H_
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+
+#if defined(__linux__)
+#define MAMAN14_PERF_EVENTS 1
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace AlgorithmsMaman14{
+
+enum HardwareEvent
+{
+	CYCLES,
+	INSTRUCTIONS,
+	CACHE_MISSES,
+	BRANCH_MISSES,
+	BACKEND_STALL_CYCLES
+};
+
+class HardwareCounter
+{
+public:
+	explicit HardwareCounter(HardwareEvent event)
+	: file(-1)
+	, value(0)
+	{
+#ifdef MAMAN14_PERF_EVENTS
+		perf_event_attr attributes;
+		std::memset(&attributes, 0, sizeof(attributes));
+		attributes.size = sizeof(attributes);
+		attributes.type = PERF_TYPE_HARDWARE;
+		attributes.config = configOf(event);
+		attributes.disabled = 1;
+		attributes.exclude_kernel = 1;
+		attributes.exclude_hv = 1;
+
+		file = syscall(SYS_perf_event_open, &attributes, 0, -1, -1, 0);
+#else
+		(void)event;
+#endif
+	}
+
+	~HardwareCounter()
+	{
+#ifdef MAMAN14_PERF_EVENTS
+		if (file >= 0)
+			close(file);
+#endif
+	}
+
+	HardwareCounter(const HardwareCounter&) = delete;
+	HardwareCounter& operator=(const HardwareCounter&) = delete;
+
+	bool isAvailable() const
+	{
+		return file >= 0;
+	}
+
+	void start()
+	{
+#ifdef MAMAN14_PERF_EVENTS
+		if (!isAvailable())
+			return;
+
+		ioctl(file, PERF_EVENT_IOC_RESET, 0);
+		ioctl(file, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+	}
+
+	void stop()
+	{
+#ifdef MAMAN14_PERF_EVENTS
+		if (!isAvailable())
+			return;
+
+		ioctl(file, PERF_EVENT_IOC_DISABLE, 0);
+		if (read(file, &value, sizeof(value)) != sizeof(value))
+			value = 0;
+#endif
+	}
+
+	// Number of events between the last start() and stop()
+	std::uint64_t count() const
+	{
+		return value;
+	}
+
+private:
+#ifdef MAMAN14_PERF_EVENTS
+	static std::uint64_t configOf(HardwareEvent event)
+	{
+		switch (event)
+		{
+		case CYCLES: return PERF_COUNT_HW_CPU_CYCLES;
+		case INSTRUCTIONS: return PERF_COUNT_HW_INSTRUCTIONS;
+		case CACHE_MISSES: return PERF_COUNT_HW_CACHE_MISSES;
+		case BRANCH_MISSES: return PERF_COUNT_HW_BRANCH_MISSES;
+		case BACKEND_STALL_CYCLES: return PERF_COUNT_HW_STALLED_CYCLES_BACKEND;
+		}
+
+		return PERF_COUNT_HW_CPU_CYCLES;
+	}
+#endif
+
+	int file;
+	std::uint64_t value;
+};
+
+// Prints the counter's count per operation, or n/a when the counter is not available
+inline std::ostream& printPerOperation(std::ostream& out, const HardwareCounter& counter, std::size_t operations)
+{
+	if (!counter.isAvailable())
+		return out << "n/a";
+
+	return out << static_cast<double>(counter.count()) / operations;
+}
+
+}
+
+#endif /* PERF_COUNTERS_H_ */
@@ -0,0 +1,110 @@
+/*
+ * prefetch_selection.h
+ *
+ *  Son selection that prefetches the levels below the sons.
+ *
+ *  Once a heap outgrows the last level cache, every level of a sift down waits for the cache miss
+ *  of the next family of sons. The descendants of consecutive nodes are consecutive too, so the
+ *  descendants of a family of sons Distance levels down form a single block of the storage.
+ *  When the block spans up to MaxLines cache lines (small d, small keys) all of it is prefetched
+ *  before the sons are compared, so the loads overlap the comparisons. Otherwise only the block
+ *  below the winning son is prefetched, as soon as the winner is known.
+ *
+ *  Distance 1 prefetches the grandchildren of the sifted node, a larger distance hides more latency
+ *  but fetches d times as much per level and wastes most of it - measure with "dheap prefetch".
+ *  Prefetching only pays off for heaps larger than the caches over a contiguous storage.
+ *
+ *  Usage: DHeap<int, std::vector<int>, 4, Less, Identity, PrefetchSelection<>>
+ *     or: DHeap<int, std::vector<int>, 8, Less, Identity, PrefetchSelection<2, 8, SimdSelection>>
+ */
+
+#ifndef PREFETCH_SELECTION_H_
+#define PREFETCH_SELECTION_H_
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+
+#include "heap.h"
+
+namespace AlgorithmsMaman14{
+
+// Default number of levels below the sons that PrefetchSelection prefetches
+const std::size_t PREFETCH_DISTANCE = 1;
+// Default number of cache lines PrefetchSelection prefetches per level
+const std::size_t PREFETCH_MAX_LINES = 8;
+
+/* Son selection policy that prefetches Distance levels below the sons and delegates
+ * the selection itself to Selection.
+ */
+template <std::size_t Distance = PREFETCH_DISTANCE, std::size_t MaxLines = PREFETCH_MAX_LINES, typename Selection = ScanSelection>
+struct PrefetchSelection
+{
+	static_assert(Distance > 0, "the sons themselves are about to be compared, prefetch at least one level below them");
+	static_assert(MaxLines > 0, "prefetch at least one cache line per level");
+
+	template <typename Heap>
+	static std::size_t largestOf(const Heap& heap, std::size_t first, std::size_t end)
+	{
+		auto below = descendantsOf(heap, first, end);
+		bool wholeBlock = linesOf(heap, below.first, below.second) <= MaxLines;
+		if (wholeBlock)
+			prefetch(heap, below.first, below.second);
+
+		auto largest = Selection::largestOf(heap, first, end);
+
+		if (!wholeBlock)
+		{
+			below = descendantsOf(heap, largest, largest + 1);
+			prefetch(heap, below.first, below.second);
+		}
+
+		return largest;
+	}
+
+private:
+	// The descendants of [first, end) Distance levels down, clipped to the heap
+	template <typename Heap>
+	static std::pair<std::size_t, std::size_t> descendantsOf(const Heap& heap, std::size_t first, std::size_t end)
+	{
+		for (std::size_t level = 0; level < Distance && first < heap.length(); ++level)
+		{
+			first = heap.firstChildOf(first);
+			end = heap.firstChildOf(end - 1) + heap.numberOfSons();
+		}
+
+		return std::make_pair(std::min(first, heap.length()), std::min(end, heap.length()));
+	}
+
+	template <typename Heap>
+	static std::size_t linesOf(const Heap& heap, std::size_t first, std::size_t end)
+	{
+		if (first >= end)
+			return 0;
+
+		return (lineOf(&heap.storage()[end - 1]) - lineOf(&heap.storage()[first])) / CACHE_LINE_SIZE + 1;
+	}
+
+	// Prefetches the cache lines of [first, end) for reading, up to MaxLines of them
+	template <typename Heap>
+	static void prefetch(const Heap& heap, std::size_t first, std::size_t end)
+	{
+		if (first >= end)
+			return;
+
+		auto line = lineOf(&heap.storage()[first]);
+		auto last = lineOf(&heap.storage()[end - 1]);
+		for (std::size_t i = 0; i < MaxLines && line <= last; ++i, line += CACHE_LINE_SIZE)
+			__builtin_prefetch(reinterpret_cast<const void*>(line), 0, 3);
+	}
+
+	// The address of the cache line that holds element
+	template <typename T>
+	static std::uintptr_t lineOf(const T* element)
+	{
+		return reinterpret_cast<std::uintptr_t>(element) & ~static_cast<std::uintptr_t>(CACHE_LINE_SIZE - 1);
+	}
+};
+
+}
+
+#endif /* PREFETCH_SELECTION_H_ */
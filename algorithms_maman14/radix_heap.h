@@ -0,0 +1,170 @@
+/*
+ * radix_heap.h
+ *
+ *  A monotone priority queue for unsigned integer keys.
+ *
+ *  The elements are kept in buckets by the highest bit in which their key differs from the last popped key.
+ *  When the bucket of equal keys runs dry, the first non-empty bucket is spread over the lower buckets,
+ *  relative to its smallest key. Every element is moved to a lower bucket at most once per bit of the key,
+ *  so an operation costs amortized O(log C) and comparing keys is hardly ever needed.
+ *
+ *  The keys pushed must not be smaller than the last popped key (e.g. simulation time or Dijkstra distances).
+ *  RadixHeap has the push/pop/root/isEmpty surface of a DHeap of std::pair<Key, Value> whose root is the smallest key.
+ */
+
+#ifndef RADIX_HEAP_H_
+#define RADIX_HEAP_H_
+#include <limits>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace AlgorithmsMaman14{
+
+template <typename Key, typename Value>
+class RadixHeap
+{
+	static_assert(std::is_integral<Key>::value && std::is_unsigned<Key>::value, "a radix heap is keyed by unsigned integers");
+	static_assert(std::numeric_limits<Key>::digits <= std::numeric_limits<unsigned long long>::digits, "keys wider than unsigned long long are not supported");
+
+public:
+	typedef std::pair<Key, Value> ValueType;
+
+	struct HeapIsEmptyException : public std::runtime_error { HeapIsEmptyException() : std::runtime_error("root of an empty heap was accessed"){} };
+	struct NonMonotonePushException : public std::invalid_argument { NonMonotonePushException() : std::invalid_argument("key pushed into a radix heap is smaller than the last popped key"){} };
+
+	RadixHeap()
+	: buckets(BUCKETS)
+	, last(0)
+	, heapSize(0)
+	{
+	}
+
+	void push(const ValueType& obj)
+	{
+		buckets[bucketOf(obj.first)].push_back(obj);
+		++heapSize;
+	}
+
+	void push(ValueType&& obj)
+	{
+		auto bucket = bucketOf(obj.first);
+		buckets[bucket].push_back(std::move(obj));
+		++heapSize;
+	}
+
+	// Constructs the element (key, value) in its bucket
+	template <typename... Args>
+	void emplace(Key key, Args&&... args)
+	{
+		auto bucket = bucketOf(key);
+		buckets[bucket].emplace_back(std::piecewise_construct, std::forward_as_tuple(key), std::forward_as_tuple(std::forward<Args>(args)...));
+		++heapSize;
+	}
+
+	/* Allows accessing the element with the smallest key.
+	 * May spread a bucket first, so it is amortized O(log C) rather than O(1).
+	 */
+	const ValueType& root() const
+	{
+		if (isEmpty())
+			throw HeapIsEmptyException();
+
+		refill();
+		return buckets[0].back();
+	}
+
+	// Removes the element with the smallest key from the heap, returning it to the caller
+	ValueType pop()
+	{
+		if (isEmpty())
+			throw HeapIsEmptyException();
+
+		refill();
+		ValueType top = std::move(buckets[0].back());
+		buckets[0].pop_back();
+		--heapSize;
+		return top;
+	}
+
+	// Same as pop(), but reports an empty heap by returning false instead of throwing
+	bool try_pop(ValueType& out)
+	{
+		if (isEmpty())
+			return false;
+
+		refill();
+		out = std::move(buckets[0].back());
+		buckets[0].pop_back();
+		--heapSize;
+		return true;
+	}
+
+	bool isEmpty() const
+	{
+		return heapSize == 0;
+	}
+
+	std::size_t length() const
+	{
+		return heapSize;
+	}
+
+	// The smallest key that may be pushed from now on
+	Key lastKey() const
+	{
+		return last;
+	}
+
+private:
+	// Bucket 0 holds the keys equal to last, bucket b the keys whose highest bit that differs from last is b - 1
+	static const std::size_t BUCKETS = std::numeric_limits<Key>::digits + 1;
+
+	std::size_t bucketOf(Key key) const
+	{
+		if (key < last)
+			throw NonMonotonePushException();
+		if (key == last)
+			return 0;
+
+		return std::numeric_limits<unsigned long long>::digits - __builtin_clzll(static_cast<unsigned long long>(key ^ last));
+	}
+
+	/* Makes sure the bucket of last is not empty, the heap is not empty.
+	 * Otherwise last is advanced to the smallest key of the first non-empty bucket and the bucket is spread,
+	 * all its keys now share a longer prefix with last so they land in lower buckets.
+	 */
+	void refill() const
+	{
+		if (!buckets[0].empty())
+			return;
+
+		std::size_t first = 1;
+		while (buckets[first].empty())
+			++first;
+
+		auto& spread = buckets[first];
+		last = spread.front().first;
+		for (const auto& element : spread)
+			if (element.first < last)
+				last = element.first;
+
+		for (auto& element : spread)
+			buckets[bucketOf(element.first)].push_back(std::move(element));
+		spread.clear();
+	}
+
+	// Spreading a bucket keeps the heap's contents, so root() can spread buckets too
+	mutable std::vector<std::vector<ValueType>> buckets;
+	mutable Key last;
+	std::size_t heapSize;
+};
+
+template <typename Key, typename Value>
+const std::size_t RadixHeap<Key, Value>::BUCKETS;
+
+}
+
+#endif /* RADIX_HEAP_H_ */
@@ -0,0 +1,387 @@
+/*
+ * simd_selection.h
+ *
+ *  Vectorized son selection for DHeaps over arithmetic keys.
+ *
+ *  The d sons of a node are stored one after the other, so for int, float, double and uint64_t
+ *  keys with d = 4, 8 or 16 they can be loaded into SSE/AVX2 registers and the best of them
+ *  found without a single branch per son.
+ *  The instruction set is chosen at runtime, CPUs without SSE4.2 use the plain scan.
+ *
+ *  The kernel trades the branches of the scan for a longer dependency chain per level,
+ *  it pays off when the sons fill at least a full AVX2 register (e.g. 8 or 16 ints and floats),
+ *  so measure before switching a heap over to it.
+ *
+ *  Usage: DHeap<int, std::vector<int>, 8, Less, Identity, SimdSelection>
+ *     or: heap_sort<SimdSelection>(8, vec)
+ *
+ *  NOTE: floating point keys must not be NaN.
+ */
+
+#ifndef SIMD_SELECTION_H_
+#define SIMD_SELECTION_H_
+#include <cstdint>
+#include <functional>
+#include <type_traits>
+
+#include "heap.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MAMAN14_SIMD_X86 1
+#include <immintrin.h>
+#define MAMAN14_TARGET_SSE4 __attribute__((target("sse4.2")))
+#define MAMAN14_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+namespace AlgorithmsMaman14{
+namespace Simd{
+
+enum InstructionSet
+{
+	SCALAR_SET,
+	SSE4_SET,
+	AVX2_SET
+};
+
+// Detects the best instruction set of the running CPU, once.
+inline InstructionSet detectInstructionSet()
+{
+#ifdef MAMAN14_SIMD_X86
+	struct Detector
+	{
+		static InstructionSet detect()
+		{
+			__builtin_cpu_init();
+			if (__builtin_cpu_supports("avx2"))
+				return AVX2_SET;
+			if (__builtin_cpu_supports("sse4.2"))
+				return SSE4_SET;
+			return SCALAR_SET;
+		}
+	};
+	static const InstructionSet detected = Detector::detect();
+	return detected;
+#else
+	return SCALAR_SET;
+#endif
+}
+
+// Portable fallback, returns the offset of the first best key out of count keys.
+template <bool Smallest, typename Key>
+std::size_t scalarBestOf(const Key* keys, std::size_t count)
+{
+	std::size_t best = 0;
+	for (std::size_t i = 1; i < count; ++i)
+		if (Smallest ? keys[i] < keys[best] : keys[i] > keys[best])
+			best = i;
+
+	return best;
+}
+
+#ifdef MAMAN14_SIMD_X86
+
+/* Lanes describe how a key type is handled by an instruction set:
+ * load - loads WIDTH keys (possibly transformed, keeping their order), best - lane-wise max (or min),
+ * spread - leaves the best key of the register in all the lanes,
+ * equalMask - a bit per lane that equals the other register.
+ */
+template <typename Key> struct Sse4Lanes;
+template <typename Key> struct Avx2Lanes;
+
+template <>
+struct Sse4Lanes<int>
+{
+	typedef __m128i Vector;
+	static const std::size_t WIDTH = 4;
+
+	MAMAN14_TARGET_SSE4 static Vector load(const int* keys) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys)); }
+	template <bool Smallest>
+	MAMAN14_TARGET_SSE4 static Vector best(Vector a, Vector b) { return Smallest ? _mm_min_epi32(a, b) : _mm_max_epi32(a, b); }
+	template <bool Smallest>
+	MAMAN14_TARGET_SSE4 static Vector spread(Vector v)
+	{
+		v = best<Smallest>(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+		return best<Smallest>(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+	}
+	MAMAN14_TARGET_SSE4 static unsigned equalMask(Vector a, Vector b) { return _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(a, b))); }
+};
+
+template <>
+struct Sse4Lanes<float>
+{
+	typedef __m128 Vector;
+	static const std::size_t WIDTH = 4;
+
+	MAMAN14_TARGET_SSE4 static Vector load(const float* keys) { return _mm_loadu_ps(keys); }
+	template <bool Smallest>
+	MAMAN14_TARGET_SSE4 static Vector best(Vector a, Vector b) { return Smallest ? _mm_min_ps(a, b) : _mm_max_ps(a, b); }
+	template <bool Smallest>
+	MAMAN14_TARGET_SSE4 static Vector spread(Vector v)
+	{
+		v = best<Smallest>(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+		return best<Smallest>(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+	}
+	MAMAN14_TARGET_SSE4 static unsigned equalMask(Vector a, Vector b) { return _mm_movemask_ps(_mm_cmpeq_ps(a, b)); }
+};
+
+template <>
+struct Sse4Lanes<double>
+{
+	typedef __m128d Vector;
+	static const std::size_t WIDTH = 2;
+
+	MAMAN14_TARGET_SSE4 static Vector load(const double* keys) { return _mm_loadu_pd(keys); }
+	template <bool Smallest>
+	MAMAN14_TARGET_SSE4 static Vector best(Vector a, Vector b) { return Smallest ? _mm_min_pd(a, b) : _mm_max_pd(a, b); }
+	template <bool Smallest>
+	MAMAN14_TARGET_SSE4 static Vector spread(Vector v) { return best<Smallest>(v, _mm_shuffle_pd(v, v, 1)); }
+	MAMAN14_TARGET_SSE4 static unsigned equalMask(Vector a, Vector b) { return _mm_movemask_pd(_mm_cmpeq_pd(a, b)); }
+};
+
+// There are no unsigned 64 bit compares, the sign bit is flipped on load so the signed compare orders the keys correctly.
+template <>
+struct Sse4Lanes<std::uint64_t>
+{
+	typedef __m128i Vector;
+	static const std::size_t WIDTH = 2;
+
+	MAMAN14_TARGET_SSE4 static Vector load(const std::uint64_t* keys)
+	{
+		const Vector sign = _mm_set1_epi64x(static_cast<long long>(0x8000000000000000ULL));
+		return _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(keys)), sign);
+	}
+	template <bool Smallest>
+	MAMAN14_TARGET_SSE4 static Vector best(Vector a, Vector b)
+	{
+		Vector aIsGreater = _mm_cmpgt_epi64(a, b);
+		return Smallest ? _mm_blendv_epi8(a, b, aIsGreater) : _mm_blendv_epi8(b, a, aIsGreater);
+	}
+	template <bool Smallest>
+	MAMAN14_TARGET_SSE4 static Vector spread(Vector v) { return best<Smallest>(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2))); }
+	MAMAN14_TARGET_SSE4 static unsigned equalMask(Vector a, Vector b) { return _mm_movemask_pd(_mm_castsi128_pd(_mm_cmpeq_epi64(a, b))); }
+};
+
+template <>
+struct Avx2Lanes<int>
+{
+	typedef __m256i Vector;
+	static const std::size_t WIDTH = 8;
+
+	MAMAN14_TARGET_AVX2 static Vector load(const int* keys) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys)); }
+	template <bool Smallest>
+	MAMAN14_TARGET_AVX2 static Vector best(Vector a, Vector b) { return Smallest ? _mm256_min_epi32(a, b) : _mm256_max_epi32(a, b); }
+	template <bool Smallest>
+	MAMAN14_TARGET_AVX2 static Vector spread(Vector v)
+	{
+		v = best<Smallest>(v, _mm256_permute2x128_si256(v, v, 1));
+		v = best<Smallest>(v, _mm256_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+		return best<Smallest>(v, _mm256_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+	}
+	MAMAN14_TARGET_AVX2 static unsigned equalMask(Vector a, Vector b) { return _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(a, b))); }
+};
+
+template <>
+struct Avx2Lanes<float>
+{
+	typedef __m256 Vector;
+	static const std::size_t WIDTH = 8;
+
+	MAMAN14_TARGET_AVX2 static Vector load(const float* keys) { return _mm256_loadu_ps(keys); }
+	template <bool Smallest>
+	MAMAN14_TARGET_AVX2 static Vector best(Vector a, Vector b) { return Smallest ? _mm256_min_ps(a, b) : _mm256_max_ps(a, b); }
+	template <bool Smallest>
+	MAMAN14_TARGET_AVX2 static Vector spread(Vector v)
+	{
+		v = best<Smallest>(v, _mm256_permute2f128_ps(v, v, 1));
+		v = best<Smallest>(v, _mm256_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+		return best<Smallest>(v, _mm256_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+	}
+	MAMAN14_TARGET_AVX2 static unsigned equalMask(Vector a, Vector b) { return _mm256_movemask_ps(_mm256_cmp_ps(a, b, _CMP_EQ_OQ)); }
+};
+
+template <>
+struct Avx2Lanes<double>
+{
+	typedef __m256d Vector;
+	static const std::size_t WIDTH = 4;
+
+	MAMAN14_TARGET_AVX2 static Vector load(const double* keys) { return _mm256_loadu_pd(keys); }
+	template <bool Smallest>
+	MAMAN14_TARGET_AVX2 static Vector best(Vector a, Vector b) { return Smallest ? _mm256_min_pd(a, b) : _mm256_max_pd(a, b); }
+	template <bool Smallest>
+	MAMAN14_TARGET_AVX2 static Vector spread(Vector v)
+	{
+		v = best<Smallest>(v, _mm256_permute2f128_pd(v, v, 1));
+		return best<Smallest>(v, _mm256_shuffle_pd(v, v, 0x5));
+	}
+	MAMAN14_TARGET_AVX2 static unsigned equalMask(Vector a, Vector b) { return _mm256_movemask_pd(_mm256_cmp_pd(a, b, _CMP_EQ_OQ)); }
+};
+
+template <>
+struct Avx2Lanes<std::uint64_t>
+{
+	typedef __m256i Vector;
+	static const std::size_t WIDTH = 4;
+
+	MAMAN14_TARGET_AVX2 static Vector load(const std::uint64_t* keys)
+	{
+		const Vector sign = _mm256_set1_epi64x(static_cast<long long>(0x8000000000000000ULL));
+		return _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys)), sign);
+	}
+	template <bool Smallest>
+	MAMAN14_TARGET_AVX2 static Vector best(Vector a, Vector b)
+	{
+		Vector aIsGreater = _mm256_cmpgt_epi64(a, b);
+		return Smallest ? _mm256_blendv_epi8(a, b, aIsGreater) : _mm256_blendv_epi8(b, a, aIsGreater);
+	}
+	template <bool Smallest>
+	MAMAN14_TARGET_AVX2 static Vector spread(Vector v)
+	{
+		v = best<Smallest>(v, _mm256_permute2x128_si256(v, v, 1));
+		return best<Smallest>(v, _mm256_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+	}
+	MAMAN14_TARGET_AVX2 static unsigned equalMask(Vector a, Vector b) { return _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(a, b))); }
+};
+
+/* Loads the Count keys into registers and reduces them into the best key,
+ * the masks of the lanes equal to it are then combined, so the first of them is found without branches.
+ * The two kernels are identical, they differ in the instructions the compiler may use.
+ */
+template <typename Lanes, bool Smallest, std::size_t Count, typename Key>
+MAMAN14_TARGET_SSE4 std::size_t sse4BestOf(const Key* keys)
+{
+	const std::size_t registers = Count / Lanes::WIDTH;
+	typename Lanes::Vector loaded[registers];
+	for (std::size_t i = 0; i < registers; ++i)
+		loaded[i] = Lanes::load(keys + i * Lanes::WIDTH);
+
+	typename Lanes::Vector best = loaded[0];
+	for (std::size_t i = 1; i < registers; ++i)
+		best = Lanes::template best<Smallest>(best, loaded[i]);
+	best = Lanes::template spread<Smallest>(best);
+
+	unsigned mask = 0;
+	for (std::size_t i = 0; i < registers; ++i)
+		mask |= Lanes::equalMask(loaded[i], best) << (i * Lanes::WIDTH);
+
+	return __builtin_ctz(mask);
+}
+
+template <typename Lanes, bool Smallest, std::size_t Count, typename Key>
+MAMAN14_TARGET_AVX2 std::size_t avx2BestOf(const Key* keys)
+{
+	const std::size_t registers = Count / Lanes::WIDTH;
+	typename Lanes::Vector loaded[registers];
+	for (std::size_t i = 0; i < registers; ++i)
+		loaded[i] = Lanes::load(keys + i * Lanes::WIDTH);
+
+	typename Lanes::Vector best = loaded[0];
+	for (std::size_t i = 1; i < registers; ++i)
+		best = Lanes::template best<Smallest>(best, loaded[i]);
+	best = Lanes::template spread<Smallest>(best);
+
+	unsigned mask = 0;
+	for (std::size_t i = 0; i < registers; ++i)
+		mask |= Lanes::equalMask(loaded[i], best) << (i * Lanes::WIDTH);
+
+	return __builtin_ctz(mask);
+}
+
+// AVX2 registers wider than the sons (e.g. 4 ints) are not worth it, those stay with SSE.
+template <bool Smallest, std::size_t Count, typename Key>
+std::size_t avx2OrSse4BestOf(const Key* keys, std::true_type)
+{
+	return avx2BestOf<Avx2Lanes<Key>, Smallest, Count>(keys);
+}
+
+template <bool Smallest, std::size_t Count, typename Key>
+std::size_t avx2OrSse4BestOf(const Key* keys, std::false_type)
+{
+	return sse4BestOf<Sse4Lanes<Key>, Smallest, Count>(keys);
+}
+
+#endif
+
+// Returns the offset of the first best key out of Count keys, using the best instruction set available.
+template <bool Smallest, std::size_t Count, typename Key>
+std::size_t bestOf(const Key* keys)
+{
+#ifdef MAMAN14_SIMD_X86
+	switch (detectInstructionSet())
+	{
+	case AVX2_SET:
+		return avx2OrSse4BestOf<Smallest, Count>(keys, std::integral_constant<bool, Count >= Avx2Lanes<Key>::WIDTH>());
+	case SSE4_SET:
+		return sse4BestOf<Sse4Lanes<Key>, Smallest, Count>(keys);
+	case SCALAR_SET:
+		break;
+	}
+#endif
+	return scalarBestOf<Smallest>(keys, Count);
+}
+
+// Keys the kernels know how to load.
+template <typename Key> struct IsVectorKey : std::false_type {};
+template <> struct IsVectorKey<int> : std::true_type {};
+template <> struct IsVectorKey<float> : std::true_type {};
+template <> struct IsVectorKey<double> : std::true_type {};
+template <> struct IsVectorKey<std::uint64_t> : std::true_type {};
+
+// Orderings the kernels know how to apply, max heaps look for the largest son and min heaps for the smallest.
+template <typename Compare, typename Key> struct VectorOrder { static const bool SUPPORTED = false; static const bool SMALLEST = false; };
+template <typename Key> struct VectorOrder<Less, Key> { static const bool SUPPORTED = true; static const bool SMALLEST = false; };
+template <typename Key> struct VectorOrder<std::less<Key>, Key> { static const bool SUPPORTED = true; static const bool SMALLEST = false; };
+template <typename Key> struct VectorOrder<std::greater<Key>, Key> { static const bool SUPPORTED = true; static const bool SMALLEST = true; };
+
+template <std::size_t Sons> struct IsVectorArity : std::false_type {};
+template <> struct IsVectorArity<4> : std::true_type {};
+template <> struct IsVectorArity<8> : std::true_type {};
+template <> struct IsVectorArity<16> : std::true_type {};
+
+// Whether a heap type can use the kernels: its elements are their own arithmetic keys, its arity is fixed
+// and its storage keeps the sons next to each other in memory.
+template <typename Heap>
+struct IsVectorHeap : std::integral_constant<bool,
+	IsContiguousStorage<typename Heap::StorageType>::value &&
+	IsVectorKey<typename Heap::ValueType>::value &&
+	VectorOrder<typename Heap::CompareType, typename Heap::ValueType>::SUPPORTED &&
+	std::is_same<typename Heap::ProjectionType, Identity>::value &&
+	IsVectorArity<Heap::SONS>::value>
+{
+};
+
+}
+
+/* Son selection policy that uses the vectorized kernels above whenever a node has all of its sons.
+ * Heaps the kernels do not support, e.g. over an IteratorRange of a std::deque,
+ * (and the last, partial, family of sons) fall back to ScanSelection.
+ */
+struct SimdSelection
+{
+	template <typename Heap>
+	static std::size_t largestOf(const Heap& heap, std::size_t first, std::size_t end)
+	{
+		return largestOf(heap, first, end, Simd::IsVectorHeap<Heap>());
+	}
+
+private:
+	template <typename Heap>
+	static std::size_t largestOf(const Heap& heap, std::size_t first, std::size_t end, std::true_type)
+	{
+		if (end - first != Heap::SONS)
+			return ScanSelection::largestOf(heap, first, end);
+
+		typedef Simd::VectorOrder<typename Heap::CompareType, typename Heap::ValueType> Order;
+		return first + Simd::bestOf<Order::SMALLEST, Heap::SONS>(&heap.storage()[first]);
+	}
+
+	template <typename Heap>
+	static std::size_t largestOf(const Heap& heap, std::size_t first, std::size_t end, std::false_type)
+	{
+		return ScanSelection::largestOf(heap, first, end);
+	}
+};
+
+}
+
+#endif /* SIMD_SELECTION_H_ */
@@ -0,0 +1,246 @@
+/*
+ * timer_queue.h
+ *
+ *  A deadline queue for an event loop, on top of DHeap.
+ *
+ *  Cancelling a timer only marks its entry dead in O(1), the entry stays in the heap and is skipped
+ *  once it reaches the root. When the dead entries exceed a fraction of the heap, after a cancel or a pop,
+ *  they are purged at once by DHeap::remove_if, which rebuilds the heap from the live entries with build_max_heap.
+ *
+ *  Usage: auto token = timers.schedule(deadline, event); ... timers.cancel(token);
+ *         ... timers.pop_expired(now, std::back_inserter(fired));
+ */
+
+#ifndef TIMER_QUEUE_H_
+#define TIMER_QUEUE_H_
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "heap.h"
+
+namespace AlgorithmsMaman14{
+
+// Default fraction of dead entries in the heap that triggers a compaction
+const double TIMER_QUEUE_MAX_DEAD_FRACTION = 0.5;
+// Heaps shorter than this are not compacted, the dead entries are left for pop to skip
+const std::size_t TIMER_QUEUE_MIN_COMPACTION_LENGTH = 64;
+// Default number of sons of the deadline heap
+const std::size_t TIMER_QUEUE_SONS = 4;
+
+// Identifies a scheduled timer, the generation tells a recycled slot from the one the token was given for
+struct TimerToken
+{
+	std::size_t slot;
+	std::uint32_t generation;
+};
+
+template <typename Payload, typename TimePoint>
+struct Timer
+{
+	TimePoint deadline;
+	Payload payload;
+};
+
+/* Timers ordered by their deadlines, the earliest deadline first.
+ * Every live timer owns a slot that records whether it is still scheduled, a token names the slot.
+ */
+template <typename Payload, typename TimePoint = std::chrono::steady_clock::time_point>
+class TimerQueue
+{
+public:
+	typedef Timer<Payload, TimePoint> TimerType;
+
+	explicit TimerQueue(double maxDeadFraction_ = TIMER_QUEUE_MAX_DEAD_FRACTION, std::size_t numberOfSons = TIMER_QUEUE_SONS)
+	: maxDeadFraction(maxDeadFraction_)
+	, dead(0)
+	, compactions(0)
+	, heap(numberOfSons, orderBy(std::greater<TimePoint>(), DeadlineOf()))
+	{
+	}
+
+	TimerToken schedule(const TimePoint& deadline, const Payload& payload)
+	{
+		std::size_t slot;
+		if (freeSlots.empty())
+		{
+			slot = slots.size();
+			slots.push_back(SlotState{0, true});
+		}
+		else
+		{
+			slot = freeSlots.back();
+			freeSlots.pop_back();
+			slots[slot].alive = true;
+		}
+
+		heap.push(Entry{deadline, slot, payload});
+		return TimerToken{slot, slots[slot].generation};
+	}
+
+	/* Marks the timer of token dead, returns false if it already fired or was cancelled.
+	 * May compact the heap, see TimerQueue(maxDeadFraction).
+	 */
+	bool cancel(const TimerToken& token)
+	{
+		if (!isScheduled(token))
+			return false;
+
+		slots[token.slot].alive = false;
+		++dead;
+		compactIfTooDead();
+
+		return true;
+	}
+
+	bool isScheduled(const TimerToken& token) const
+	{
+		return token.slot < slots.size() && slots[token.slot].generation == token.generation && slots[token.slot].alive;
+	}
+
+	// Removes the timer with the earliest deadline into out, returns false if no timer is scheduled
+	bool try_pop(TimerType& out)
+	{
+		skipDead();
+		if (heap.isEmpty())
+			return false;
+
+		Entry earliest = heap.pop();
+		release(earliest.slot);
+		compactIfTooDead();
+		out = TimerType{earliest.deadline, std::move(earliest.payload)};
+		return true;
+	}
+
+	/* Removes all the timers whose deadline is not later than now into out, earliest first.
+	 * Returns the end of the output.
+	 */
+	template <typename OutputIterator>
+	OutputIterator pop_expired(const TimePoint& now, OutputIterator out)
+	{
+		for (skipDead(); !heap.isEmpty() && !(now < heap.root().deadline); skipDead())
+		{
+			Entry earliest = heap.pop();
+			release(earliest.slot);
+			compactIfTooDead();
+			*out++ = TimerType{earliest.deadline, std::move(earliest.payload)};
+		}
+
+		return out;
+	}
+
+	// The earliest deadline of a scheduled timer, throws HeapIsEmptyException if none is scheduled
+	const TimePoint& nextDeadline()
+	{
+		skipDead();
+		return heap.root().deadline;
+	}
+
+	// Number of scheduled timers
+	std::size_t length() const
+	{
+		return heap.length() - dead;
+	}
+
+	bool isEmpty() const
+	{
+		return length() == 0;
+	}
+
+	// Number of entries in the heap, the scheduled timers and the cancelled ones not purged yet
+	std::size_t numberOfEntries() const
+	{
+		return heap.length();
+	}
+
+	// Fraction of the heap's entries that belong to cancelled timers
+	double deadRatio() const
+	{
+		return heap.isEmpty() ? 0 : static_cast<double>(dead) / heap.length();
+	}
+
+	// Number of times the dead entries were purged by a compaction
+	std::size_t numberOfCompactions() const
+	{
+		return compactions;
+	}
+
+	// Purges all the dead entries from the heap
+	void compact()
+	{
+		heap.remove_if([this](const Entry& entry)
+		{
+			if (slots[entry.slot].alive)
+				return false;
+
+			release(entry.slot);
+			return true;
+		});
+
+		dead = 0;
+		++compactions;
+	}
+
+private:
+	struct Entry
+	{
+		TimePoint deadline;
+		std::size_t slot;
+		Payload payload;
+	};
+
+	struct DeadlineOf
+	{
+		const TimePoint& operator()(const Entry& entry) const
+		{
+			return entry.deadline;
+		}
+	};
+
+	struct SlotState
+	{
+		std::uint32_t generation;
+		bool alive;
+	};
+
+	// Pops the dead entries off the root
+	void skipDead()
+	{
+		while (!heap.isEmpty() && !slots[heap.root().slot].alive)
+		{
+			release(heap.pop().slot);
+			--dead;
+		}
+
+		compactIfTooDead();
+	}
+
+	/* Compacts the heap once the dead entries exceed maxDeadFraction of it.
+	 * Called after every removal, popping live entries raises the fraction just like cancelling does.
+	 */
+	void compactIfTooDead()
+	{
+		if (heap.length() >= TIMER_QUEUE_MIN_COMPACTION_LENGTH && deadRatio() > maxDeadFraction)
+			compact();
+	}
+
+	// The slot's entry left the heap, the tokens given for it become stale
+	void release(std::size_t slot)
+	{
+		slots[slot].alive = false;
+		++slots[slot].generation;
+		freeSlots.push_back(slot);
+	}
+
+	double maxDeadFraction;
+	std::size_t dead;
+	std::size_t compactions;
+	std::vector<SlotState> slots;
+	std::vector<std::size_t> freeSlots;
+	DHeap<Entry, std::vector<Entry>, RUNTIME_ARITY, std::greater<TimePoint>, DeadlineOf> heap;
+};
+
+}
+
+#endif /* TIMER_QUEUE_H_ */
@@ -0,0 +1,145 @@
+/*
+ * top_k.h
+ *
+ *  Streaming selection of the k largest elements.
+ *
+ *  The k largest elements seen so far are kept in a DHeap whose root is the smallest of them,
+ *  an element that beats the root replaces it with a single replace_top and any other element is
+ *  dropped after one comparison. Selection costs O(n log k) time and O(k) memory.
+ *
+ *  Usage: auto largest = top_k(samples.begin(), samples.end(), 1000);
+ *     or: TopK<Sample> largest(1000); ... largest.push(sample); ... largest.sorted();
+ */
+
+#ifndef TOP_K_H_
+#define TOP_K_H_
+#include <algorithm>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+#include "heap.h"
+
+namespace AlgorithmsMaman14{
+
+// Default number of sons of the heap kept by TopK
+const std::size_t TOP_K_SONS = 4;
+
+// Orders the heap of TopK so that its root is the smallest element by Compare
+template <typename Compare>
+struct ReverseOrder
+{
+	template <typename U>
+	bool operator()(const U& lhs, const U& rhs) const
+	{
+		return compare(rhs, lhs);
+	}
+
+	Compare compare;
+};
+
+/* Accumulates the k largest of the pushed elements by compare (on their projections).
+ * Ties with the smallest kept element do not replace it, so the first of the equal elements are kept.
+ */
+template <typename T, typename Compare = Less, typename Projection = Identity>
+class TopK
+{
+public:
+	typedef DHeap<T, std::vector<T>, RUNTIME_ARITY, ReverseOrder<Compare>, Projection> Heap;
+
+	explicit TopK(std::size_t k_, const Compare& compare_ = Compare(), const Projection& projection_ = Projection(),
+				  std::size_t numberOfSons = TOP_K_SONS)
+	: k(k_)
+	, compare(compare_)
+	, projection(projection_)
+	, heap(numberOfSons, orderBy(ReverseOrder<Compare>{compare_}, projection_), reserved(k_))
+	{
+	}
+
+	void push(const T& element)
+	{
+		if (heap.length() < k)
+			heap.push(element);
+		else if (k > 0 && beatsSmallest(element))
+			heap.replace_top(element);
+	}
+
+	void push(T&& element)
+	{
+		if (heap.length() < k)
+			heap.push(std::move(element));
+		else if (k > 0 && beatsSmallest(element))
+			heap.replace_top(std::move(element));
+	}
+
+	template <typename InputIterator>
+	void push(InputIterator first, InputIterator last)
+	{
+		for (; first != last; ++first)
+			push(*first);
+	}
+
+	// The smallest of the kept elements, an element has to beat it to be kept
+	const T& threshold() const
+	{
+		return heap.root();
+	}
+
+	std::size_t size() const
+	{
+		return heap.length();
+	}
+
+	std::size_t capacity() const
+	{
+		return k;
+	}
+
+	bool isEmpty() const
+	{
+		return heap.isEmpty();
+	}
+
+	// The kept elements, from the largest to the smallest
+	std::vector<T> sorted() const
+	{
+		std::vector<T> largest(heap.storage().begin(), heap.storage().begin() + heap.length());
+		std::sort(largest.begin(), largest.end(), [this](const T& lhs, const T& rhs) { return compare(projection(rhs), projection(lhs)); });
+		return largest;
+	}
+
+private:
+	static std::vector<T> reserved(std::size_t capacity)
+	{
+		std::vector<T> elements;
+		elements.reserve(capacity);
+		return elements;
+	}
+
+	bool beatsSmallest(const T& element) const
+	{
+		return compare(projection(heap.root()), projection(element));
+	}
+
+	std::size_t k;
+	Compare compare;
+	Projection projection;
+	Heap heap;
+};
+
+/* Returns the k largest elements of [first, last) by compare, from the largest to the smallest.
+ * The range is read once, so input iterators (e.g. std::istream_iterator) are enough.
+ */
+template <typename InputIterator, typename Compare = Less, typename Projection = Identity>
+std::vector<typename std::iterator_traits<InputIterator>::value_type>
+top_k(InputIterator first, InputIterator last, std::size_t k, const Compare& compare = Compare(), const Projection& projection = Projection(),
+	  std::size_t numberOfSons = TOP_K_SONS)
+{
+	TopK<typename std::iterator_traits<InputIterator>::value_type, Compare, Projection> largest(k, compare, projection, numberOfSons);
+	largest.push(first, last);
+	return largest.sorted();
+}
+
+}
+
+#endif /* TOP_K_H_ */
@@ -103,9 +103,10 @@ string Unlimited::extractNextDigits(const string::const_reverse_iterator& leastS
 	return string(currentDigits.rbegin(), currentDigits.rend());
 }
 
-int stoi(const std::string& str)
+// Named apart from std::stoi, which the using directive in unlimited.h makes ambiguous with it
+static int digitsToInt(const std::string& str)
 {
-	return strtol(str.c_str(), NULL, 0);
+	return strtol(str.c_str(), NULL, 10);
 }
 
 void Unlimited::parseNonNegativeStringRepresentation(string::const_reverse_iterator mostSignificant,
@@ -114,7 +115,7 @@ void Unlimited::parseNonNegativeStringRepresentation(string::const_reverse_itera
 	for(; mostSignificant != leastSignificant;)
 	{
 		string currentDigits = extractNextDigits(leastSignificant, mostSignificant);
-		insertMostSignificantDigit(stoi(currentDigits));
+		insertMostSignificantDigit(digitsToInt(currentDigits));
 	}
 }
 